@@ -0,0 +1,229 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <limits>
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <exprc/alloc.h>
+#include <exprc/dfg.h>
+#include <exprc/parse.h>
+#include <exprc/schedule.h>
+#include <exprc/translate.h>
+#include <exprc/verilog.h>
+
+#include "generate.h"
+
+namespace {
+
+struct Options {
+    std::vector<uint32_t> sizes = {1000, 10000, 100000, 1000000};
+    exprc::bench::GenerateOptions generate;
+    // every size is compiled again until it took this many seconds
+    double min_time = 1;
+    bool json = false;
+};
+
+const char* const PASSES[] = {"parse", "translate", "dfg", "schedule", "allocate", "dump"};
+constexpr size_t PASS_COUNT = std::size(PASSES);
+
+struct Result {
+    uint32_t assignments = 0;
+    size_t source_bytes = 0;
+    size_t instructions = 0;
+    // control steps executing operations, as --stats counts them
+    uint32_t steps = 0;
+    size_t verilog_bytes = 0;
+    uint32_t runs = 0;
+    // the fastest run of every pass
+    double seconds[PASS_COUNT];
+};
+
+// counts what is written into it and throws it away
+class CountingBuffer : public std::streambuf {
+public:
+    size_t count() const {
+        return m_count;
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        ++m_count;
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char*, std::streamsize n) override {
+        m_count += static_cast<size_t>(n);
+        return n;
+    }
+
+private:
+    size_t m_count = 0;
+};
+
+void usage() {
+    std::cout << "exprc-bench [--sizes N,N,...] [--min-time S] [--json] [exprc-gen options]" << std::endl;
+    std::cout << "    --sizes N,N,...  compile programs of these numbers of assignments, 1000,10000,100000,1000000 by default" << std::endl;
+    std::cout << "    --min-time S     compile every program again until it took S seconds, 1 by default" << std::endl;
+    std::cout << "    --json           write results as JSON instead of CSV" << std::endl;
+    std::cout << "    options of exprc-gen but --assignments shape the programs" << std::endl;
+}
+
+std::vector<uint32_t> toSizes(const std::string& arg) {
+    std::vector<uint32_t> sizes;
+    size_t begin = 0;
+    while (begin <= arg.size()) {
+        auto end = std::min(arg.find(',', begin), arg.size());
+        auto size = arg.substr(begin, end - begin);
+        if (size.empty() || size.find_first_not_of("0123456789") != std::string::npos || size.size() > 9 || std::stoul(size) == 0)
+            throw std::invalid_argument(fmt::format("expected positive numbers of assignments given '{}'", arg));
+        sizes.push_back(static_cast<uint32_t>(std::stoul(size)));
+        begin = end + 1;
+    }
+    return sizes;
+}
+
+Options parseArgs(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() {
+            if (i + 1 == argc)
+                throw std::invalid_argument(fmt::format("{} expects a value", arg));
+            return std::string(argv[++i]);
+        };
+        if (arg == "--sizes")
+            options.sizes = toSizes(value());
+        else if (arg == "--min-time") {
+            auto time = value();
+            size_t end = 0;
+            try {
+                options.min_time = std::stod(time, &end);
+            }
+            catch (const std::logic_error&) {
+            }
+            if (end != time.size() || time.empty() || !(options.min_time >= 0))
+                throw std::invalid_argument(fmt::format("expected seconds given '{}'", time));
+        }
+        else if (arg == "--json")
+            options.json = true;
+        else if (arg == "--assignments" || !exprc::bench::parseGenerateOption(options.generate, argc, argv, i))
+            throw std::invalid_argument(fmt::format("unexpected argument '{}'", arg));
+    }
+    return options;
+}
+
+// compiles the program again and again, passes take what the one before
+// gave, so every run is timed pass by pass
+Result run(uint32_t assignments, const Options& options) {
+    auto generate = options.generate;
+    generate.assignments = assignments;
+    auto text = exprc::bench::generate(generate);
+
+    Result result;
+    result.assignments = assignments;
+    result.source_bytes = text.size();
+    std::fill(std::begin(result.seconds), std::end(result.seconds), std::numeric_limits<double>::infinity());
+    std::chrono::duration<double> total{};
+    do {
+        std::chrono::duration<double> times[PASS_COUNT];
+        auto start = std::chrono::steady_clock::now();
+        auto lap = [&](size_t pass) {
+            auto now = std::chrono::steady_clock::now();
+            times[pass] = now - start;
+            start = now;
+        };
+        auto program = exprc::ast::parse(text);
+        lap(0);
+        auto [sequence, names, reused] = exprc::translate(program);
+        lap(1);
+        auto dfg = exprc::Dfg::fromSequence(sequence);
+        lap(2);
+        auto sched = exprc::schedule(sequence, dfg);
+        lap(3);
+        auto data_path = exprc::allocate(sched, names);
+        lap(4);
+        CountingBuffer buffer;
+        std::ostream os(&buffer);
+        exprc::verilog::dump(os, data_path);
+        lap(5);
+
+        for (size_t pass = 0; pass < PASS_COUNT; ++pass) {
+            result.seconds[pass] = std::min(result.seconds[pass], times[pass].count());
+            total += times[pass];
+        }
+        result.instructions = sequence.size();
+        result.steps = sched.latency();
+        result.verilog_bytes = buffer.count();
+        ++result.runs;
+    } while (total.count() < options.min_time);
+    return result;
+}
+
+void printCsvHeader() {
+    std::cout << "assignments,source_bytes,instructions,steps,verilog_bytes,runs";
+    for (auto* pass : PASSES)
+        std::cout << "," << pass << "_s";
+    std::cout << ",total_s" << std::endl;
+}
+
+void printCsv(const Result& result) {
+    std::cout << fmt::format("{},{},{},{},{},{}", result.assignments, result.source_bytes, result.instructions, result.steps, result.verilog_bytes, result.runs);
+    double total = 0;
+    for (auto seconds : result.seconds) {
+        std::cout << fmt::format(",{:.6f}", seconds);
+        total += seconds;
+    }
+    std::cout << fmt::format(",{:.6f}", total) << std::endl;
+}
+
+void printJson(const Result& result, bool first) {
+    std::cout << (first ? "[\n" : ",\n");
+    std::cout << fmt::format("  {{\"assignments\": {}, \"source_bytes\": {}, \"instructions\": {}, \"steps\": {}, \"verilog_bytes\": {}, \"runs\": {}, \"seconds\": {{",
+                             result.assignments, result.source_bytes, result.instructions, result.steps, result.verilog_bytes, result.runs);
+    double total = 0;
+    for (size_t pass = 0; pass < PASS_COUNT; ++pass) {
+        std::cout << fmt::format("\"{}\": {:.6f}, ", PASSES[pass], result.seconds[pass]);
+        total += result.seconds[pass];
+    }
+    std::cout << fmt::format("\"total\": {:.6f}}}}}", total) << std::flush;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    Options options;
+    try {
+        options = parseArgs(argc, argv);
+    }
+    catch (const std::invalid_argument& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        usage();
+        return 1;
+    }
+
+    try {
+        if (!options.json)
+            printCsvHeader();
+        for (size_t i = 0; i < options.sizes.size(); ++i) {
+            auto result = run(options.sizes[i], options);
+            if (options.json)
+                printJson(result, i == 0);
+            else
+                printCsv(result);
+        }
+        if (options.json)
+            std::cout << "\n]" << std::endl;
+    }
+    catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,38 @@
+#include <iostream>
+#include <stdexcept>
+#include <string>
+
+#include <fmt/format.h>
+
+#include "generate.h"
+
+namespace {
+
+void usage() {
+    std::cout << "exprc-gen [--assignments N] [--inputs N] [--outputs N] [--depth N] [--fanout N] [--mul-ratio R] [--seed N]" << std::endl;
+    std::cout << "    --assignments N  assign N variables, 1000 by default" << std::endl;
+    std::cout << "    --inputs N       read N inputs, 8 by default" << std::endl;
+    std::cout << "    --outputs N      write N outputs, 4 by default" << std::endl;
+    std::cout << "    --depth N        chain assignments N deep, square root of their number by default" << std::endl;
+    std::cout << "    --fanout N       use every value N times on average, 3 by default" << std::endl;
+    std::cout << "    --mul-ratio R    make R of operators '*' and the rest '+', 0.5 by default" << std::endl;
+    std::cout << "    --seed N         seed random choices, 1 by default" << std::endl;
+}
+
+} // namespace
+
+int main(int argc, char* argv[]) {
+    exprc::bench::GenerateOptions options;
+    try {
+        for (int i = 1; i < argc; ++i)
+            if (!exprc::bench::parseGenerateOption(options, argc, argv, i))
+                throw std::invalid_argument(fmt::format("unexpected argument '{}'", argv[i]));
+        std::cout << exprc::bench::generate(options);
+    }
+    catch (const std::invalid_argument& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        usage();
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,177 @@
+#include "generate.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <stdexcept>
+#include <vector>
+
+#include <fmt/format.h>
+
+namespace exprc {
+
+namespace bench {
+
+namespace {
+
+// splitmix64, so that a seed gives the same program everywhere
+class Random {
+public:
+    explicit Random(uint64_t seed)
+        : m_state(seed) {
+    }
+
+    uint64_t next() {
+        uint64_t z = (m_state += 0x9e3779b97f4a7c15);
+        z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+        z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+        return z ^ (z >> 31);
+    }
+
+    uint64_t below(uint64_t n) {
+        return next() % n;
+    }
+
+    double unit() {
+        return static_cast<double>(next() >> 11) / static_cast<double>(uint64_t(1) << 53);
+    }
+
+private:
+    uint64_t m_state;
+};
+
+uint32_t toCount(const std::string& arg, const std::string& value) {
+    if (value.empty() || value.find_first_not_of("0123456789") != std::string::npos || value.size() > 9)
+        throw std::invalid_argument(fmt::format("{} expects a number given '{}'", arg, value));
+    return static_cast<uint32_t>(std::stoul(value));
+}
+
+} // namespace
+
+std::string generate(const GenerateOptions& options) {
+    if (!options.assignments || !options.inputs || !options.outputs || !options.fanout)
+        throw std::invalid_argument("programs take at least an assignment, input, output and use of a value");
+    if (!(options.mul_ratio >= 0 && options.mul_ratio <= 1))
+        throw std::invalid_argument(fmt::format("share of '*' has to be within [0, 1] given {}", options.mul_ratio));
+
+    auto n = options.assignments;
+    auto depth = options.depth ? std::min(options.depth, n) : std::max(1u, static_cast<uint32_t>(std::lround(std::sqrt(n))));
+    // first assignment of every level and one past the last
+    std::vector<uint32_t> begin;
+    for (uint32_t level = 0; level <= depth; ++level)
+        begin.push_back(static_cast<uint32_t>(uint64_t(level) * n / depth));
+
+    Random random(options.seed);
+    std::vector<bool> used(n);
+    // values are used in order they are defined, so those before this one
+    // are used
+    uint32_t unused = 0;
+    fmt::memory_buffer buf;
+    auto input = [&]() {
+        return fmt::format("i{}", random.below(options.inputs));
+    };
+    auto value = [&](uint32_t from, uint32_t to) {
+        auto id = from + static_cast<uint32_t>(random.below(to - from));
+        used[id] = true;
+        return fmt::format("v{}", id);
+    };
+
+    for (uint32_t level = 0; level < depth; ++level) {
+        for (auto id = begin[level]; id < begin[level + 1]; ++id) {
+            // as many leaves as fanout on average
+            auto leaves = 1 + random.below(2 * uint64_t(options.fanout) - 1);
+            fmt::format_to(std::back_inserter(buf), "v{} = ", id);
+            for (uint64_t leaf = 0; leaf < leaves; ++leaf) {
+                if (leaf)
+                    fmt::format_to(std::back_inserter(buf), " {} ", random.unit() < options.mul_ratio ? '*' : '+');
+                if (!level) {
+                    fmt::format_to(std::back_inserter(buf), "{}", input());
+                    continue;
+                }
+                // the first leaf makes the level deeper than the one before
+                // and takes the oldest value no one uses yet
+                if (!leaf) {
+                    while (unused < begin[level] && used[unused])
+                        ++unused;
+                    if (unused < begin[level]) {
+                        used[unused] = true;
+                        fmt::format_to(std::back_inserter(buf), "v{}", unused);
+                    }
+                    else
+                        fmt::format_to(std::back_inserter(buf), "{}", value(begin[level - 1], begin[level]));
+                    continue;
+                }
+                switch (random.below(4)) {
+                case 0:
+                    fmt::format_to(std::back_inserter(buf), "{}", input());
+                    break;
+                case 1:
+                    fmt::format_to(std::back_inserter(buf), "{}", value(0, begin[level]));
+                    break;
+                default:
+                    fmt::format_to(std::back_inserter(buf), "{}", value(begin[level - 1], begin[level]));
+                    break;
+                }
+            }
+            fmt::format_to(std::back_inserter(buf), ";\n");
+        }
+    }
+
+    // values left unused are spread over outputs, outputs left with none
+    // take a value of the last level
+    std::vector<std::vector<uint32_t>> outputs(options.outputs);
+    uint32_t next = 0;
+    for (auto id = unused; id < n; ++id)
+        if (!used[id])
+            outputs[next++ % options.outputs].push_back(id);
+    for (auto& output : outputs) {
+        if (output.empty())
+            output.push_back(begin[depth - 1] + static_cast<uint32_t>(random.below(n - begin[depth - 1])));
+    }
+    for (size_t i = 0; i < outputs.size(); ++i) {
+        fmt::format_to(std::back_inserter(buf), "out o{} = ", i);
+        for (size_t j = 0; j < outputs[i].size(); ++j)
+            fmt::format_to(std::back_inserter(buf), "{}v{}", j ? " + " : "", outputs[i][j]);
+        fmt::format_to(std::back_inserter(buf), ";\n");
+    }
+    return fmt::to_string(buf);
+}
+
+bool parseGenerateOption(GenerateOptions& options, int argc, char* argv[], int& i) {
+    std::string arg = argv[i];
+    auto value = [&]() {
+        if (i + 1 == argc)
+            throw std::invalid_argument(fmt::format("{} expects a value", arg));
+        return std::string(argv[++i]);
+    };
+    if (arg == "--assignments")
+        options.assignments = toCount(arg, value());
+    else if (arg == "--inputs")
+        options.inputs = toCount(arg, value());
+    else if (arg == "--outputs")
+        options.outputs = toCount(arg, value());
+    else if (arg == "--depth")
+        options.depth = toCount(arg, value());
+    else if (arg == "--fanout")
+        options.fanout = toCount(arg, value());
+    else if (arg == "--seed")
+        options.seed = toCount(arg, value());
+    else if (arg == "--mul-ratio") {
+        auto ratio = value();
+        size_t end = 0;
+        try {
+            options.mul_ratio = std::stod(ratio, &end);
+        }
+        catch (const std::logic_error&) {
+        }
+        if (end != ratio.size() || ratio.empty())
+            throw std::invalid_argument(fmt::format("{} expects a number given '{}'", arg, ratio));
+    }
+    else
+        return false;
+    return true;
+}
+
+} // namespace bench
+
+} // namespace exprc
@@ -0,0 +1,38 @@
+#ifndef EXPRC_BENCH_GENERATE_H
+#define EXPRC_BENCH_GENERATE_H
+
+#include <cstdint>
+#include <string>
+
+namespace exprc {
+
+namespace bench {
+
+struct GenerateOptions {
+    uint32_t assignments = 1000;
+    uint32_t inputs = 8;
+    uint32_t outputs = 4;
+    // levels of assignments, every one reading a value of the level before,
+    // 0 for as many as there are assignments in a level
+    uint32_t depth = 0;
+    // uses of a value on average, that is variables and inputs on the right
+    // hand side of an assignment
+    uint32_t fanout = 3;
+    // share of operators being '*'
+    double mul_ratio = 0.5;
+    uint64_t seed = 1;
+};
+
+// random program whose assignments form a DAG of the given shape, every
+// value is used and those used by no assignment are summed into outputs
+std::string generate(const GenerateOptions&);
+
+// parses --assignments N, --inputs N, --outputs N, --depth N, --fanout N,
+// --mul-ratio R and --seed N of argv[i] and its value, true if taken
+bool parseGenerateOption(GenerateOptions&, int argc, char* argv[], int& i);
+
+} // namespace bench
+
+} // namespace exprc
+
+#endif // EXPRC_BENCH_GENERATE_H
@@ -1,26 +1,51 @@
 #ifndef EXPRC_ALLOC_H
 #define EXPRC_ALLOC_H
 
-#include <functional>
-#include <map>
-#include <unordered_map>
+#include <cstdint>
 #include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include <exprc/dev.h>
 #include <exprc/ir.h>
+#include <exprc/schedule.h>
 
 namespace exprc {
 
+struct Driver {
+    dev::InPort::Id in;
+    dev::OutPort::Id out;
+};
+
 struct DataPath {
     std::list<dev::Input> inputs;
     std::list<dev::Output> outputs;
+    std::list<dev::Constant> constants;
     std::list<dev::Adder> adders;
     std::list<dev::Multiplier> multipliers;
+    std::list<dev::ConstMultiplier> const_multipliers;
     std::unordered_map<dev::DeviceId, dev::Register> registers;
-    std::map<std::tuple<uint32_t, dev::InPort::Id>, dev::OutPort::Id> drivers;
+    // connections made in every control step ordered by in port,
+    // the last step only drives outputs
+    std::vector<std::vector<Driver>> drivers;
+    // a pipelined data path takes new inputs every initiation interval cycles
+    // and drivers are given per phase then, results come out after the latency
+    uint32_t initiation_interval = 0;
+    uint32_t latency = 0;
 };
 
-DataPath allocate(const std::multimap<uint32_t, std::reference_wrapper<const Instruction>>&, const std::unordered_map<Operand::Id, const std::string>&);
+struct AllocOptions {
+    // bind operations to devices and values to registers reusing connections
+    // made in earlier steps, otherwise the N-th operation of a step goes to
+    // the N-th device of its kind
+    bool interconnect_aware = true;
+};
+
+DataPath allocate(const Schedule&, const NameTable&, const AllocOptions& = {});
+
+// number of inputs of multiplexers in front of in ports driven from more than one out port
+uint32_t countMuxInputs(const DataPath&);
 
 } // namespace exprc
 
@@ -0,0 +1,42 @@
+#ifndef EXPRC_BATCH_H
+#define EXPRC_BATCH_H
+
+#include <string>
+#include <vector>
+
+#include <exprc/exprc.h>
+
+namespace exprc {
+
+namespace batch {
+
+struct Job {
+    std::string input;
+    // file given verilog or C++ of the program
+    std::string output;
+};
+
+struct Result {
+    // empty when the program is compiled and written
+    std::string error;
+    double seconds = 0;
+};
+
+// programs of a directory, its .txt files, or of a manifest listing a path
+// a line relative to the manifest, '#' starts a comment; outputs are named
+// after programs with the extension and go into output_dir, or next to
+// programs when it is empty; throws std::invalid_argument when an output
+// would overwrite a program or another output
+std::vector<Job> jobs(const std::string& path, const std::string& output_dir, const std::string& extension);
+
+// compiles jobs on a pool of threads, each taking jobs of its own, largest
+// first, and stealing the smallest of others when out of them; an error of a
+// job goes into its result and leaves others running; zero threads stand
+// for as many as the host runs at once
+std::vector<Result> run(const std::vector<Job>&, const CompileOptions&, unsigned threads = 0);
+
+} // namespace batch
+
+} // namespace exprc
+
+#endif // EXPRC_BATCH_H
@@ -0,0 +1,27 @@
+#ifndef EXPRC_CPP_H
+#define EXPRC_CPP_H
+
+#include <ostream>
+
+#include <exprc/ir.h>
+
+namespace exprc {
+
+namespace cpp {
+
+struct DumpOptions {
+    // add main() running the function over random arrays to measure
+    // elements per second
+    bool harness = false;
+};
+
+// function exprc(n, inputs..., outputs...) computing the sequence over
+// arrays of n elements, one array per input and output in order of
+// instructions, so that a compiler vectorises the loop over elements
+void dump(std::ostream&, const Sequence&, const NameTable&, const DumpOptions& = {});
+
+} // namespace cpp
+
+} // namespace exprc
+
+#endif // EXPRC_CPP_H
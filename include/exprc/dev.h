@@ -2,6 +2,7 @@
 #define EXPRC_DEV_H
 
 #include <array>
+#include <cstdint>
 #include <ostream>
 #include <string>
 #include <variant>
@@ -40,6 +41,9 @@ enum class DeviceId : uint32_t {
     FIRST_VALID_ID = 0,
 };
 
+// all ports of a device are width bits wide, functional units and registers
+// are widened to the widest value they are bound to
+
 struct Input {
     operator DeviceId() const {
         return id;
@@ -50,6 +54,7 @@ struct Input {
     const std::string name;
     OutPort out;
     std::array<InPort, 0> in;
+    uint32_t width = 0;
 };
 
 struct Output {
@@ -61,6 +66,20 @@ struct Output {
 
     const std::string name;
     std::array<InPort, 1> in;
+    uint32_t width = 0;
+};
+
+struct Constant {
+    operator DeviceId() const {
+        return id;
+    }
+
+    const DeviceId id;
+
+    const uint64_t value;
+    OutPort out;
+    std::array<InPort, 0> in;
+    uint32_t width = 0;
 };
 
 struct Adder {
@@ -72,8 +91,11 @@ struct Adder {
 
     OutPort out;
     std::array<InPort, 2> in;
+    uint32_t width = 0;
 };
 
+// result of a multiplier is ready latency cycles after it takes operands,
+// a pipelined one keeps partial results in its internal registers
 struct Multiplier {
     operator DeviceId() const {
         return id;
@@ -81,8 +103,26 @@ struct Multiplier {
 
     const DeviceId id;
 
+    const uint32_t latency;
+    const bool pipelined;
     OutPort out;
     std::array<InPort, 2> in;
+    uint32_t width = 0;
+};
+
+// multiplier by a constant is reduced to shifts and adds by synthesis,
+// so it is much cheaper than a general one
+struct ConstMultiplier {
+    operator DeviceId() const {
+        return id;
+    }
+
+    const DeviceId id;
+
+    const uint64_t value;
+    OutPort out;
+    std::array<InPort, 1> in;
+    uint32_t width = 0;
 };
 
 struct Register {
@@ -94,9 +134,10 @@ struct Register {
 
     OutPort out;
     std::array<InPort, 1> in;
+    uint32_t width = 0;
 };
 
-using Device = std::variant<InPort, OutPort, Input, Adder, Multiplier, Register>;
+using Device = std::variant<InPort, OutPort, Input, Constant, Adder, Multiplier, ConstMultiplier, Register>;
 
 class Context {
 public:
@@ -106,6 +147,12 @@ public:
     template <typename T>
     T make(const std::string&);
 
+    template <typename T>
+    T make(uint64_t);
+
+    template <typename T>
+    T make(uint32_t, bool);
+
 private:
     util::IdGen<InPort::Id> m_next_in_id;
     util::IdGen<OutPort::Id> m_next_out_id;
@@ -132,14 +179,24 @@ inline Output Context::make<Output>(const std::string& name) {
     return Output{m_next_id(), name, {make<InPort>()}};
 }
 
+template <>
+inline Constant Context::make<Constant>(uint64_t value) {
+    return Constant{m_next_id(), value, make<OutPort>()};
+}
+
 template <>
 inline Adder Context::make<Adder>() {
     return Adder{m_next_id(), make<OutPort>(), {make<InPort>(), make<InPort>()}};
 }
 
 template <>
-inline Multiplier Context::make<Multiplier>() {
-    return Multiplier{m_next_id(), make<OutPort>(), {make<InPort>(), make<InPort>()}};
+inline Multiplier Context::make<Multiplier>(uint32_t latency, bool pipelined) {
+    return Multiplier{m_next_id(), latency, pipelined, make<OutPort>(), {make<InPort>(), make<InPort>()}};
+}
+
+template <>
+inline ConstMultiplier Context::make<ConstMultiplier>(uint64_t value) {
+    return ConstMultiplier{m_next_id(), value, make<OutPort>(), {make<InPort>()}};
 }
 
 template <>
@@ -168,6 +225,13 @@ inline std::ostream& operator<<(std::ostream& os, const Output& output) {
     return os;
 }
 
+inline std::ostream& operator<<(std::ostream& os, const Constant& constant) {
+    os << "CONST<" << util::asInt(constant.id) << "> "
+       << "<Value:" << constant.value << ">"
+       << "<Out:" << constant.out << ">";
+    return os;
+}
+
 inline std::ostream& operator<<(std::ostream& os, const Adder& adder) {
     os << "ADDER<" << util::asInt(adder.id) << "> "
        << "<Out:" << adder.out << ">";
@@ -178,6 +242,16 @@ inline std::ostream& operator<<(std::ostream& os, const Adder& adder) {
 
 inline std::ostream& operator<<(std::ostream& os, const Multiplier& multiplier) {
     os << "MULTIPLIER<" << util::asInt(multiplier.id) << "> "
+       << "<Latency:" << multiplier.latency << (multiplier.pipelined ? ", pipelined" : "") << ">"
+       << "<Out:" << multiplier.out << ">";
+    for (auto& port : multiplier.in)
+       os << "<In:" << port << ">";
+    return os;
+}
+
+inline std::ostream& operator<<(std::ostream& os, const ConstMultiplier& multiplier) {
+    os << "CONST_MULTIPLIER<" << util::asInt(multiplier.id) << "> "
+       << "<Value:" << multiplier.value << ">"
        << "<Out:" << multiplier.out << ">";
     for (auto& port : multiplier.in)
        os << "<In:" << port << ">";
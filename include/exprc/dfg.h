@@ -1,35 +1,83 @@
 #ifndef EXPRC_DFG_H
 #define EXPRC_DFG_H
 
-#include <functional>
-#include <unordered_map>
-#include <iterator>
-#include <type_traits>
+#include <cstdint>
+#include <vector>
 
 #include <exprc/ir.h>
+#include <exprc/util.h>
 
 namespace exprc {
 
+// adjacency of the sequence in compressed sparse row form:
+// uses of every operand and sources of every instruction are
+// contiguous ranges of instruction ids
 class Dfg {
 public:
     Dfg(const Dfg&) = delete;
     Dfg(Dfg&&) = default;
 
-    auto usedBy(const Operand& op) const {
-        return m_used_by.equal_range(op);
+    // instructions reading the operand
+    util::Span<Instruction::Id> usedBy(const Operand& op) const {
+        auto id = util::asInt(op.id);
+        return span(m_uses, m_use_begin[id], m_use_begin[id + 1]);
     }
 
     const Instruction& definedBy(const Operand& op) const {
-        return m_defined_by.at(op);
+        return (*m_sequence)[m_defined_by[util::asInt(op.id)]];
     }
 
-    static Dfg fromSequence(const std::list<Instruction>&);
+    // instructions defining sources of the instruction, in order of sources
+    util::Span<Instruction::Id> predecessors(const Instruction& instr) const {
+        auto id = util::asInt(instr.id);
+        return span(m_preds, m_pred_begin[id], m_pred_begin[id + 1]);
+    }
+
+    // instructions reading result of the instruction
+    util::Span<Instruction::Id> successors(const Instruction& instr) const {
+        if (!instr.dst)
+            return {};
+        return usedBy(*instr.dst);
+    }
+
+    uint32_t fanIn(const Instruction& instr) const {
+        return static_cast<uint32_t>(predecessors(instr).size());
+    }
+
+    uint32_t fanOut(const Instruction& instr) const {
+        return static_cast<uint32_t>(successors(instr).size());
+    }
+
+    // every instruction comes after the ones defining its sources,
+    // a sequence which is already ordered so is kept as is
+    util::Span<Instruction::Id> topologicalOrder() const {
+        return span(m_topological_order, 0, m_topological_order.size());
+    }
+
+    const Sequence& sequence() const {
+        return *m_sequence;
+    }
+
+    static Dfg fromSequence(const Sequence&);
 
 private:
-    Dfg(const std::list<Instruction>&);
+    Dfg(const Sequence&);
+
+    void sortTopologically();
+
+    static util::Span<Instruction::Id> span(const std::vector<Instruction::Id>& ids, size_t begin, size_t end) {
+        return {ids.data() + begin, ids.data() + end};
+    }
 
-    std::unordered_map<Operand::Id, std::reference_wrapper<const Instruction>> m_defined_by;
-    std::unordered_multimap<Operand::Id, std::reference_wrapper<const Instruction>> m_used_by;
+    const Sequence* m_sequence;
+    // indexed by operand id
+    std::vector<Instruction::Id> m_defined_by;
+    std::vector<uint32_t> m_use_begin;
+    std::vector<Instruction::Id> m_uses;
+    // indexed by instruction id
+    std::vector<uint32_t> m_pred_begin;
+    std::vector<Instruction::Id> m_preds;
+    std::vector<Instruction::Id> m_topological_order;
 };
 
 } // namespace
@@ -0,0 +1,99 @@
+#ifndef EXPRC_EVAL_H
+#define EXPRC_EVAL_H
+
+#include <cstdint>
+#include <vector>
+
+#include <exprc/ir.h>
+#include <exprc/parse.h>
+#include <exprc/translate.h>
+#include <exprc/util.h>
+
+namespace exprc {
+
+// values of the sequence in as few slots as possible: a value takes a slot
+// when computed and frees it after its last use, but only once the result of
+// the instruction has taken one, so that no instruction writes a slot it reads
+struct Slots {
+    std::vector<uint32_t> by_operand;
+    uint32_t count = 0;
+};
+
+Slots assignSlots(const Sequence&);
+
+// bits of the narrowest of 8, 16, 32 or 64 bit lanes holding every value
+uint32_t laneWidth(const Sequence&);
+
+// evaluators take values of inputs for every vector one after another in
+// order of INPUT instructions of the sequence and give values of outputs
+// likewise in order of OUTPUT instructions
+
+// runs the sequence over batches of vectors, a batch goes through one
+// instruction after another with a lane per vector as wide as the widest
+// value, so that an instruction is a few SIMD operations on the whole batch
+class Evaluator {
+public:
+    explicit Evaluator(const Sequence&);
+
+    void run(util::Span<uint64_t> inputs, std::vector<uint64_t>& outputs) const;
+
+    size_t inputCount() const {
+        return m_inputs;
+    }
+
+    size_t outputCount() const {
+        return m_outputs;
+    }
+
+    uint32_t laneWidth() const {
+        return m_lane_width;
+    }
+
+    // instruction set the batches are run with, chosen by the host
+    static const char* isa();
+
+    // an instruction over values held in slots, which are reused once
+    // values in them are no longer needed
+    struct Op {
+        Opcode opcode;
+        // slot of the result, index of the output for OUTPUT
+        uint32_t dst;
+        // slots of sources, index of the input for INPUT
+        uint32_t a;
+        uint32_t b;
+        uint64_t value;
+        uint64_t mask;
+    };
+
+private:
+    std::vector<Op> m_ops;
+    uint32_t m_slots = 0;
+    uint32_t m_inputs = 0;
+    uint32_t m_outputs = 0;
+    uint32_t m_lane_width = 8;
+};
+
+// evaluates the program as written one vector at a time, to check the
+// sequence translated from it against
+class ReferenceEvaluator {
+public:
+    ReferenceEvaluator(const ast::Program&, const Sequence&, const NameTable&, const TranslateOptions&);
+
+    void run(util::Span<uint64_t> inputs, std::vector<uint64_t>& outputs) const;
+
+private:
+    const ast::Program& m_program;
+    // names of inputs and outputs, widths of inputs
+    std::vector<ast::NameId> m_inputs;
+    std::vector<uint64_t> m_input_masks;
+    std::vector<ast::NameId> m_outputs;
+    // values wrap around at the width of outputs
+    uint64_t m_mask;
+};
+
+// random values of inputs of the sequence, as wide as the inputs
+std::vector<uint64_t> randomVectors(const Sequence&, uint64_t vectors, uint64_t seed);
+
+} // namespace exprc
+
+#endif // EXPRC_EVAL_H
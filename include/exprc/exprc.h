@@ -0,0 +1,72 @@
+#ifndef EXPRC_EXPRC_H
+#define EXPRC_EXPRC_H
+
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <string_view>
+
+#include <exprc/alloc.h>
+#include <exprc/cpp.h>
+#include <exprc/dfg.h>
+#include <exprc/ir.h>
+#include <exprc/parse.h>
+#include <exprc/schedule.h>
+#include <exprc/stats.h>
+#include <exprc/translate.h>
+#include <exprc/verilog.h>
+
+namespace exprc {
+
+// what compile() writes once the data path is made, NONE only runs passes
+enum class Emit {
+    VERILOG,
+    CPP,
+    NONE,
+};
+
+// results of passes made so far, those not made yet are null
+struct Compilation {
+    const ast::Program* program = nullptr;
+    const Sequence* sequence = nullptr;
+    const NameTable* names = nullptr;
+    // instructions removed by value numbering
+    uint32_t reused = 0;
+    const Dfg* dfg = nullptr;
+    const Schedule* schedule = nullptr;
+    const DataPath* data_path = nullptr;
+    // work of the observer may be timed as passes too
+    stats::PassTimer* timer = nullptr;
+};
+
+struct CompileOptions {
+    TranslateOptions translate;
+    ScheduleOptions schedule;
+    AllocOptions alloc;
+    Emit emit = Emit::VERILOG;
+    verilog::DumpOptions verilog;
+    // C++ is written right after translation, with no schedule
+    cpp::DumpOptions cpp;
+    // count statistics of the design, passes are timed anyway
+    bool stats = false;
+    // called after parse, translate, dfg, schedule and allocate passes
+    std::function<void(const char* pass, const Compilation&)> observer;
+};
+
+struct CompileResult {
+    // verilog or C++
+    std::string output;
+    stats::Report stats;
+};
+
+// throws std::invalid_argument for options which do not go together
+void validate(const CompileOptions&);
+
+// compiles program text in memory, errors in it are thrown as
+// std::invalid_argument; every call keeps its state to itself, so calls
+// run concurrently from many threads
+CompileResult compile(std::string_view source, const CompileOptions& = {});
+
+} // namespace exprc
+
+#endif // EXPRC_EXPRC_H
@@ -2,11 +2,12 @@
 #define EXPRC_IR_H
 
 #include <cstdint>
-#include <list>
 #include <type_traits>
 #include <tuple>
 #include <ostream>
 #include <optional>
+#include <string>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 
@@ -14,11 +15,18 @@
 
 namespace exprc {
 
+// values are at most this many bits wide, so constants fit into uint64_t
+constexpr uint32_t MAX_WIDTH = 64;
+
 enum class Opcode {
     INPUT,
     OUTPUT,
+    // constant given by the immediate
+    CONST,
     ADD,
     MUL,
+    // multiplication of the source by the immediate
+    MULC,
 };
 
 struct Operand {
@@ -38,6 +46,9 @@ struct Instruction {
         FIRST_VALID_ID = 0,
     };
 
+    // no opcode takes more than two sources
+    using Sources = util::StaticVector<Operand, 2>;
+
     operator Id() const {
         return id;
     }
@@ -45,21 +56,75 @@ struct Instruction {
     const Id id;
     Opcode opcode;
     std::optional<Operand> dst;
-    std::vector<Operand> src;
+    Sources src;
+    uint64_t value = 0;
+    // bits of the result, or of the port of INPUT and OUTPUT
+    uint32_t width = 0;
 };
 
 using Context = util::Context<Operand, Instruction>;
 
+// instructions and operands are numbered densely in the order they are made,
+// so their ids index the sequence and per operand tables of operandCount() size
+class Sequence {
+public:
+    Sequence() = default;
+
+    Sequence(std::vector<Instruction> instrs, uint32_t operand_count)
+        : m_instrs(std::move(instrs))
+        , m_operand_count(operand_count) {
+    }
+
+    auto begin() const {
+        return m_instrs.begin();
+    }
+
+    auto end() const {
+        return m_instrs.end();
+    }
+
+    size_t size() const {
+        return m_instrs.size();
+    }
+
+    bool empty() const {
+        return m_instrs.empty();
+    }
+
+    const Instruction& operator[](Instruction::Id id) const {
+        return m_instrs[util::asInt(id)];
+    }
+
+    uint32_t operandCount() const {
+        return m_operand_count;
+    }
+
+private:
+    std::vector<Instruction> m_instrs;
+    uint32_t m_operand_count = 0;
+};
+
+// names the program gives to inputs, by their operands, and to outputs,
+// by their OUTPUT instructions as several outputs may share a value
+struct NameTable {
+    std::unordered_map<Operand::Id, const std::string> inputs;
+    std::unordered_map<Instruction::Id, const std::string> outputs;
+};
+
 inline constexpr auto toStr(Opcode opcode) {
     switch (opcode) {
     case Opcode::INPUT:
         return "INPUT";
     case Opcode::OUTPUT:
         return "OUTPUT";
+    case Opcode::CONST:
+        return "CONST";
     case Opcode::ADD:
         return "ADD";
     case Opcode::MUL:
         return "MUL";
+    case Opcode::MULC:
+        return "MULC";
     }
     return "???";
 }
@@ -74,7 +139,9 @@ inline std::ostream& operator<<(std::ostream&os, const Instruction& instr) {
        os << *instr.dst << " = <" << toStr(instr.opcode) << ">";
     for (auto& oper : instr.src)
         os << " " << oper;
-    return os;
+    if (instr.opcode == Opcode::CONST || instr.opcode == Opcode::MULC)
+        os << " #" << instr.value;
+    return os << " <Width:" << instr.width << ">";
 }
 
 } // namespace exprc
@@ -1,49 +1,103 @@
 #ifndef EXPRC_PARSE_H
 #define EXPRC_PARSE_H
 
+#include <cstdint>
 #include <istream>
-#include <list>
 #include <string>
-#include <memory>
+#include <string_view>
 #include <variant>
+#include <vector>
+
+#include <exprc/util.h>
 
 namespace exprc {
 
 namespace ast {
 
-struct Var;
-struct Add;
-struct Mul;
+enum class NameId : uint32_t {
+    FIRST_VALID_ID = 0,
+};
+
+enum class ExprId : uint32_t {
+    FIRST_VALID_ID = 0,
+};
+
+// interns variable names into a single character buffer
+class Names {
+public:
+    NameId intern(std::string_view);
 
-using Expr = std::variant<Var, Add, Mul>;
+    std::string_view operator[](NameId id) const {
+        auto [offset, size] = m_spans[util::asInt(id)];
+        return std::string_view(m_chars.data() + offset, size);
+    }
+
+    size_t size() const {
+        return m_spans.size();
+    }
+
+private:
+    void rehash(size_t);
+
+    std::string m_chars;
+    std::vector<std::pair<uint32_t, uint32_t>> m_spans;
+    // open addressing table of ids shifted by one, zero marks an empty slot
+    std::vector<uint32_t> m_slots;
+};
 
 struct Var {
-    std::string name;
+    NameId name;
+};
+
+// unsigned number, truncated to the width of operands when translated
+struct Literal {
+    uint64_t value;
 };
 
 struct Add {
-    std::unique_ptr<Expr> a;
-    std::unique_ptr<Expr> b;
+    ExprId a;
+    ExprId b;
 };
 
 struct Mul {
-    std::unique_ptr<Expr> a;
-    std::unique_ptr<Expr> b;
+    ExprId a;
+    ExprId b;
 };
 
+using Expr = std::variant<Var, Literal, Add, Mul>;
+
 struct AssignVar {
-    std::string name;
-    std::unique_ptr<Expr> expr;
+    NameId name;
+    ExprId expr;
 };
 
 struct AssignOut {
-    std::string name;
-    std::unique_ptr<Expr> expr;
+    NameId name;
+    ExprId expr;
+};
+
+// input of the given width in bits
+struct DeclareIn {
+    NameId name;
+    uint32_t width;
 };
 
-using Assign = std::variant<AssignVar, AssignOut>;
+using Assign = std::variant<AssignVar, AssignOut, DeclareIn>;
+
+// nodes are stored in post order: operands of an expression precede it and
+// expressions of an assignment follow those of the previous assignment
+struct Program {
+    const Expr& operator[](ExprId id) const {
+        return exprs[util::asInt(id)];
+    }
+
+    std::vector<Expr> exprs;
+    std::vector<Assign> assigns;
+    Names names;
+};
 
-std::list<Assign> parse(std::istream&);
+Program parse(std::string_view);
+Program parse(std::istream&);
 
 } // namespace ast
 
@@ -1,14 +1,114 @@
 #ifndef EXPRC_SCHEDULE_H
 #define EXPRC_SCHEDULE_H
 
-#include <map>
+#include <cstdint>
+#include <vector>
 
 #include <exprc/dfg.h>
 #include <exprc/ir.h>
+#include <exprc/util.h>
 
 namespace exprc {
 
-std::multimap<uint32_t, std::reference_wrapper<const Instruction>> schedule(const std::list<Instruction>&, const Dfg&);
+// cycles functional units take, the result of an operation is ready at the end
+// of the last one; a pipelined unit takes new operands every cycle, others are
+// busy until the result is ready and need their operands kept till then
+struct UnitTiming {
+    uint32_t latency(const Instruction& instr) const {
+        return instr.opcode == Opcode::MUL ? mul_latency : 1;
+    }
+
+    uint32_t busy(const Instruction& instr) const {
+        return instr.opcode == Opcode::MUL && !pipelined_mul ? mul_latency : 1;
+    }
+
+    uint32_t mul_latency = 1;
+    bool pipelined_mul = false;
+};
+
+// instructions bucketed by control step, zero step holds only INPUT and
+// the last one only OUTPUT instructions, buckets keep topological order;
+// operations of the same step are chained when one takes result of another,
+// operations of multi-cycle units start steps before their results are ready,
+// in a pipelined schedule a new iteration starts every initiation interval
+class Schedule {
+public:
+    Schedule(const Dfg&, std::vector<uint32_t> step_by_instr, uint32_t initiation_interval = 0, UnitTiming = {});
+
+    util::Span<Instruction::Id> at(uint32_t step) const {
+        return {m_instrs.data() + m_step_begin[step], m_instrs.data() + m_step_begin[step + 1]};
+    }
+
+    uint32_t stepOf(const Instruction& instr) const {
+        return m_step_by_instr[util::asInt(instr.id)];
+    }
+
+    // step at the end of which the result of the instruction is ready
+    uint32_t readyAt(const Instruction& instr) const {
+        return stepOf(instr) + m_timing.latency(instr) - 1;
+    }
+
+    const UnitTiming& timing() const {
+        return m_timing;
+    }
+
+    uint32_t lastStep() const {
+        return static_cast<uint32_t>(m_step_begin.size() - 2);
+    }
+
+    // control steps executing operations, i.e. without input and output ones
+    uint32_t latency() const {
+        return lastStep() - 1;
+    }
+
+    // zero for a schedule which is not pipelined
+    uint32_t initiationInterval() const {
+        return m_initiation_interval;
+    }
+
+    // steps of a pipelined schedule running at the same time, i.e. sharing
+    // functional units, have the same phase, otherwise phase is the step itself
+    uint32_t phaseOf(uint32_t step) const {
+        return m_initiation_interval ? (step + m_initiation_interval - 1) % m_initiation_interval : step;
+    }
+
+    // largest number of units busy with the opcode in a single phase
+    uint32_t peakUsage(Opcode) const;
+
+    const Sequence& sequence() const {
+        return *m_sequence;
+    }
+
+private:
+    const Sequence* m_sequence;
+    uint32_t m_initiation_interval;
+    UnitTiming m_timing;
+    std::vector<uint32_t> m_step_by_instr;
+    std::vector<uint32_t> m_step_begin;
+    std::vector<Instruction::Id> m_instrs;
+};
+
+struct ScheduleOptions {
+    // functional units usable in a single control step, zero means unlimited
+    uint32_t max_adders = 0;
+    uint32_t max_multipliers = 0;
+    // balance usage of functional units over steps of the given latency,
+    // zero latency stands for the critical path length
+    bool force_directed = false;
+    uint32_t latency = 0;
+    // start a new iteration every given number of steps, zero disables pipelining,
+    // functional units default to the least number the interval needs
+    uint32_t initiation_interval = 0;
+    // dependent operations are chained within a step while their delays
+    // add up to the clock period, zero disables chaining; delays are of
+    // 8 bit operations in ns and scale with width
+    double clock_period = 0;
+    double add_delay = 1.0;
+    double mul_delay = 3.0;
+    UnitTiming timing;
+};
+
+Schedule schedule(const Sequence&, const Dfg&, const ScheduleOptions& = {});
 
 } // namespace exprc
 
@@ -0,0 +1,120 @@
+#ifndef EXPRC_SIM_H
+#define EXPRC_SIM_H
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <exprc/alloc.h>
+#include <exprc/util.h>
+
+namespace exprc {
+
+namespace sim {
+
+struct Stats {
+    uint64_t vectors = 0;
+    // cycles from taking the first inputs till the last outputs are done,
+    // inputs are given as soon as the data path is ready for them
+    uint64_t cycles = 0;
+    // cycles from taking inputs till their outputs are done
+    uint32_t latency = 0;
+    // cycles from taking inputs till taking the next ones
+    uint32_t interval = 0;
+    // cycles in which functional units take operands, by their names in the
+    // verilog module: adders, multipliers, then constant multipliers
+    std::vector<std::pair<std::string, uint64_t>> busy;
+};
+
+// executes the data path cycle by cycle as the verilog module does: in every
+// state functional units take operands from their drivers, chained ones in
+// order, and registers are written at the end of the cycle
+class Simulator {
+public:
+    explicit Simulator(const DataPath&);
+
+    // inputs hold values of DataPath::inputs in order for every vector one
+    // after another, outputs are given likewise in order of DataPath::outputs
+    Stats run(util::Span<uint64_t> inputs, std::vector<uint64_t>& outputs);
+
+    size_t inputCount() const {
+        return m_inputs.size();
+    }
+
+    size_t outputCount() const {
+        return m_outputs.size();
+    }
+
+private:
+    // what a functional unit does in a state, operands and results are
+    // indexed by out port ids
+    struct Op {
+        enum class Kind : uint8_t {
+            ADD,
+            MUL,
+            MULC,
+            // first stage of a pipelined multiplier, result is the index of the stage
+            ISSUE,
+        };
+
+        Kind kind;
+        uint32_t res;
+        uint32_t a;
+        uint32_t b;
+        uint64_t mask;
+        uint64_t value;
+    };
+
+    // register or output taking a value
+    struct Write {
+        uint32_t dst;
+        uint32_t src;
+        uint64_t mask;
+    };
+
+    // partial products of a pipelined multiplier, the first stage takes the
+    // product of the cycle and the last one drives the out port
+    struct Pipeline {
+        uint32_t out;
+        uint32_t first;
+        uint32_t stages;
+    };
+
+    void compile(const DataPath&);
+    bool orderWrites(std::vector<uint32_t>&, std::vector<std::vector<uint32_t>>&, std::vector<uint8_t>&);
+    void step(uint32_t state);
+    void setInputs(const uint64_t* values);
+    void getOutputs(uint64_t* values);
+
+    std::vector<uint64_t> m_values;
+    std::vector<uint64_t> m_stages;
+    std::vector<uint64_t> m_next;
+    // out ports of inputs, writes of outputs
+    std::vector<std::pair<uint32_t, uint64_t>> m_inputs;
+    std::vector<Write> m_outputs;
+    // ops and writes of every state are contiguous, indexed by state
+    std::vector<Op> m_ops;
+    std::vector<uint32_t> m_op_begin;
+    std::vector<Write> m_writes;
+    std::vector<uint32_t> m_write_begin;
+    // states whose writes go through copies, indexed by state
+    std::vector<uint8_t> m_staged;
+    std::vector<Pipeline> m_pipelines;
+    // names of functional units and states they take operands in
+    std::vector<std::pair<std::string, std::vector<uint32_t>>> m_units;
+    uint32_t m_last_state;
+    uint32_t m_initiation_interval;
+    uint32_t m_latency;
+};
+
+// one vector a line of whitespace separated values of inputs, decimal or hex
+// with 0x, '#' comments out the rest of a line
+std::vector<uint64_t> parseVectors(std::string_view, size_t inputs);
+
+} // namespace sim
+
+} // namespace exprc
+
+#endif // EXPRC_SIM_H
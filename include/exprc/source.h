@@ -0,0 +1,40 @@
+#ifndef EXPRC_SOURCE_H
+#define EXPRC_SOURCE_H
+
+#include <cstddef>
+#include <istream>
+#include <string>
+#include <string_view>
+
+namespace exprc {
+
+// program text which stays in memory for the whole compilation,
+// regular files are mapped, anything else (pipes, streams) is read in full
+class Source {
+public:
+    Source(const Source&) = delete;
+    Source(Source&&) noexcept;
+    Source& operator=(const Source&) = delete;
+    Source& operator=(Source&&) = delete;
+    ~Source();
+
+    std::string_view text() const {
+        return m_text;
+    }
+
+    static Source fromFile(const std::string&);
+    static Source fromStream(std::istream&);
+    static Source fromString(std::string);
+
+private:
+    Source() = default;
+
+    std::string m_buf;
+    void* m_map = nullptr;
+    size_t m_map_size = 0;
+    std::string_view m_text;
+};
+
+} // namespace exprc
+
+#endif // EXPRC_SOURCE_H
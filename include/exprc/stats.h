@@ -0,0 +1,102 @@
+#ifndef EXPRC_STATS_H
+#define EXPRC_STATS_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include <exprc/alloc.h>
+#include <exprc/ir.h>
+#include <exprc/schedule.h>
+
+namespace exprc {
+
+namespace stats {
+
+// allocations made by the calling thread so far; they are counted only if
+// the program replaces operator new with one calling countAllocation(), as
+// exprc does, the library leaves that choice to programs using it
+struct Allocations {
+    uint64_t count = 0;
+    uint64_t bytes = 0;
+};
+
+const Allocations& threadAllocations();
+void countAllocation(size_t bytes);
+
+struct Pass {
+    const char* name;
+    // seconds since the first pass started
+    double start = 0;
+    double wall = 0;
+    // seconds of the calling thread
+    double cpu = 0;
+    uint64_t allocations = 0;
+    uint64_t allocated_bytes = 0;
+};
+
+// measures passes run one after another on the calling thread
+class PassTimer {
+public:
+    void start(const char* name);
+    void stop();
+
+    const std::vector<Pass>& passes() const {
+        return m_passes;
+    }
+
+private:
+    std::vector<Pass> m_passes;
+    std::chrono::steady_clock::time_point m_first;
+    std::chrono::steady_clock::time_point m_wall;
+    double m_cpu = 0;
+    Allocations m_allocations;
+};
+
+struct Design {
+    size_t instructions = 0;
+    // control steps executing operations, as ScheduleOptions::latency
+    uint32_t steps = 0;
+    uint32_t initiation_interval = 0;
+    size_t adders = 0;
+    size_t multipliers = 0;
+    size_t const_multipliers = 0;
+    size_t registers = 0;
+    uint64_t register_bits = 0;
+    uint32_t mux_inputs = 0;
+};
+
+Design design(const Sequence&, const Schedule&, const DataPath&);
+
+// largest resident set of the process so far in bytes
+uint64_t peakRss();
+
+struct Report {
+    std::vector<Pass> passes;
+    // not given when no data path is made, e.g. for C++
+    std::optional<Design> design;
+    // of the whole process, whatever else it runs, so compile() leaves it
+    // to the program reporting it
+    uint64_t peak_rss = 0;
+};
+
+// tables for people to read
+void printPasses(std::ostream&, const Report&);
+void printDesign(std::ostream&, const Design&);
+
+// an object of everything in the report
+void writeJson(std::ostream&, const Report&);
+
+// passes as complete events of the Chrome trace event format, which
+// chrome://tracing and Perfetto show on a timeline
+void writeTrace(std::ostream&, const Report&);
+
+} // namespace stats
+
+} // namespace exprc
+
+#endif // EXPRC_STATS_H
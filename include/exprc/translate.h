@@ -1,17 +1,28 @@
 #ifndef EXPRC_TRANSLATE_H
 #define EXPRC_TRANSLATE_H
 
-#include <list>
-#include <string>
+#include <cstdint>
 #include <tuple>
-#include <unordered_map>
 
 #include <exprc/ir.h>
 #include <exprc/parse.h>
 
 namespace exprc {
 
-std::tuple<std::list<Instruction>, std::unordered_map<Operand::Id, const std::string>> translate(const std::list<ast::Assign>&);
+struct TranslateOptions {
+    // rebuild chains of + and * as trees of the least height
+    bool reassociate = true;
+    // width of inputs not declared otherwise and of outputs
+    uint32_t width = 8;
+    // values wrap around at the width, otherwise they grow to keep every bit
+    bool full_precision = false;
+};
+
+// the number returned along is of operations found by value numbering
+// to compute an existing value, so not emitted; every instruction is given
+// the least width holding its result, which is at most the width of outputs
+// unless values are in full precision
+std::tuple<Sequence, NameTable, uint32_t> translate(const ast::Program&, const TranslateOptions& = {});
 
 } // namespace exprc
 
@@ -1,20 +1,21 @@
 #ifndef EXPRC_UTIL_H
 #define EXPRC_UTIL_H
 
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <iterator>
+#include <new>
+#include <optional>
+#include <stdexcept>
 #include <type_traits>
 #include <tuple>
+#include <vector>
 
 namespace exprc {
 
 namespace util {
 
-namespace details {
-
-template <typename I>
-using is_input_iterator = std::is_convertible<typename std::iterator_traits<I>::iterator_category*, typename std::input_iterator_tag*>;
-
-} // namespace details
-
 template <typename IdType>
 constexpr auto asInt(IdType id) {
     return static_cast<std::underlying_type_t<IdType>>(id);
@@ -27,6 +28,10 @@ public:
         return static_cast<IdType>(m_next++);
     }
 
+    auto count() const {
+        return m_next - asInt(IdType::FIRST_VALID_ID);
+    }
+
 private:
     std::underlying_type_t<IdType> m_next{asInt(IdType::FIRST_VALID_ID)};
 };
@@ -41,26 +46,168 @@ public:
         return Type{std::get<GenType>(m_next_id)(), std::forward<Args>(args)...};
     }
 
+    template <typename Type>
+    auto count() const {
+        using GenType = IdGen<typename Type::Id>;
+        return std::get<GenType>(m_next_id).count();
+    }
+
 private:
     std::tuple<IdGen<typename Types::Id>...> m_next_id;
 };
 
-} // namespace util
+// number of bits needed to hold the value, zero takes one bit
+inline uint32_t bitWidth(uint64_t value) {
+    return value ? 64 - __builtin_clzll(value) : 1;
+}
 
-} // namespace exprc
+// view of contiguous elements owned elsewhere
+template <typename T>
+class Span {
+public:
+    Span() = default;
 
-namespace std {
+    Span(const T* begin, const T* end)
+        : m_begin(begin)
+        , m_end(end) {
+    }
 
-template <typename I>
-constexpr std::enable_if_t<exprc::util::details::is_input_iterator<I>{}, I> begin(std::pair<I, I> pair) {
-    return pair.first;
-}
+    const T* begin() const {
+        return m_begin;
+    }
 
-template <typename I>
-constexpr std::enable_if_t<exprc::util::details::is_input_iterator<I>{}, I> end(std::pair<I, I> pair) {
-    return pair.second;
-}
+    const T* end() const {
+        return m_end;
+    }
+
+    const T& operator[](size_t i) const {
+        return m_begin[i];
+    }
+
+    size_t size() const {
+        return m_end - m_begin;
+    }
+
+    bool empty() const {
+        return m_begin == m_end;
+    }
+
+private:
+    const T* m_begin = nullptr;
+    const T* m_end = nullptr;
+};
+
+// vector of at most N elements kept inline, elements may have const members
+template <typename T, size_t N>
+class StaticVector {
+    static_assert(std::is_trivially_copyable_v<T> && std::is_trivially_destructible_v<T>);
+
+public:
+    StaticVector() = default;
+
+    StaticVector(std::initializer_list<T> values) {
+        for (auto& value : values)
+            push_back(value);
+    }
+
+    void push_back(const T& value) {
+        new (m_storage + sizeof(T) * m_size++) T(value);
+    }
 
-} // namespace std
+    const T* begin() const {
+        return std::launder(reinterpret_cast<const T*>(m_storage));
+    }
+
+    const T* end() const {
+        return begin() + m_size;
+    }
+
+    const T& operator[](size_t i) const {
+        return begin()[i];
+    }
+
+    const T& at(size_t i) const {
+        if (i >= m_size)
+            throw std::out_of_range("StaticVector::at");
+        return begin()[i];
+    }
+
+    size_t size() const {
+        return m_size;
+    }
+
+    bool empty() const {
+        return m_size == 0;
+    }
+
+private:
+    alignas(T) unsigned char m_storage[sizeof(T) * N];
+    uint8_t m_size = 0;
+};
+
+// dense set of small non-negative integers, a word of the summary marks
+// words holding any element, so that the smallest ones are found skipping
+// 4096 absent at once
+class BitSet {
+public:
+    void insert(size_t i) {
+        auto w = i / WORD_BITS;
+        if (w >= m_words.size()) {
+            m_words.resize(w + 1);
+            m_summary.resize(w / WORD_BITS + 1);
+        }
+        m_words[w] |= uint64_t(1) << (i % WORD_BITS);
+        m_summary[w / WORD_BITS] |= uint64_t(1) << (w % WORD_BITS);
+    }
+
+    void erase(size_t i) {
+        auto w = i / WORD_BITS;
+        if (w >= m_words.size())
+            return;
+        m_words[w] &= ~(uint64_t(1) << (i % WORD_BITS));
+        if (!m_words[w])
+            m_summary[w / WORD_BITS] &= ~(uint64_t(1) << (w % WORD_BITS));
+    }
+
+    bool contains(size_t i) const {
+        return i / WORD_BITS < m_words.size() && (m_words[i / WORD_BITS] >> (i % WORD_BITS)) & 1;
+    }
+
+    // the smallest element
+    std::optional<size_t> first() const {
+        return next(0);
+    }
+
+    // the smallest element not less than given one
+    std::optional<size_t> next(size_t i) const {
+        auto w = i / WORD_BITS;
+        if (w >= m_words.size())
+            return std::nullopt;
+        if (auto word = m_words[w] & (~uint64_t(0) << (i % WORD_BITS)))
+            return w * WORD_BITS + __builtin_ctzll(word);
+        // words after w holding elements
+        ++w;
+        for (auto s = w / WORD_BITS; s < m_summary.size(); ++s) {
+            auto summary = m_summary[s];
+            if (s == w / WORD_BITS)
+                summary &= ~uint64_t(0) << (w % WORD_BITS);
+            if (summary) {
+                auto found = s * WORD_BITS + __builtin_ctzll(summary);
+                return found * WORD_BITS + __builtin_ctzll(m_words[found]);
+            }
+        }
+        return std::nullopt;
+    }
+
+private:
+    static constexpr size_t WORD_BITS = 64;
+
+    std::vector<uint64_t> m_words;
+    std::vector<uint64_t> m_summary;
+};
+
+} // namespace util
+
+} // namespace exprc
 
 #endif // EXPRC_UTIL_H
@@ -9,7 +9,18 @@ namespace exprc {
 
 namespace verilog {
 
-void dump(std::ostream&, const DataPath&);
+struct DumpOptions {
+    // drive in ports of functional units X by default before the case over
+    // states instead of in every state they are not used in
+    bool compact = false;
+    // give every in port of a functional unit a case of its own, which lists
+    // only states it is driven in, not combined with compact
+    bool case_muxes = false;
+};
+
+// ports are named after inputs and outputs, throws std::invalid_argument
+// when one is a keyword of verilog or a name of a signal of the module
+void dump(std::ostream&, const DataPath&, const DumpOptions& = {});
 
 } // namespace verilog
 
@@ -1,41 +1,72 @@
 #include <exprc/alloc.h>
 
 #include <algorithm>
+#include <array>
 #include <cassert>
-#include <map>
+#include <functional>
+#include <limits>
 #include <list>
-#include <queue>
+#include <map>
+#include <numeric>
+#include <optional>
 #include <unordered_map>
 #include <iostream>
 #include <type_traits>
+#include <vector>
 
 #include <exprc/ir.h>
 #include <exprc/dev.h>
 #include <exprc/dfg.h>
+#include <exprc/schedule.h>
 
 namespace exprc {
 
 namespace {
 
+// devices of a kind are shared between control steps and created on demand,
+// arguments are passed to every one made, e.g. the value of a constant multiplier
 template <typename D>
 class DevicePool {
 public:
-    DevicePool(dev::Context& context)
-        : m_context(context)
-        , m_unallocated(m_list.begin()) {
+    template <typename... Args>
+    DevicePool(dev::Context& context, Args... args)
+        : m_make([&context, args...]() {
+            return context.make<D>(args...);
+        }) {
     }
 
-    auto& alloc() {
-        if (m_unallocated == m_list.end()) {
-            auto& dev = m_list.emplace_back(m_context.make<D>());
-            m_unallocated = m_list.end();
-            return dev;
+    auto& at(size_t index) {
+        while (m_index.size() <= index) {
+            auto& dev = m_list.emplace_back(m_make());
+            for (auto& in : dev.in) {
+                if (util::asInt(in.id) >= m_index_by_in.size())
+                    m_index_by_in.resize(util::asInt(in.id) + 1);
+                m_index_by_in[util::asInt(in.id)] = m_index.size();
+            }
+            m_index.push_back(&dev);
+            m_busy_until.push_back(0);
         }
-        return *m_unallocated++;
+        return *m_index[index];
+    }
+
+    // a device runs a single operation a step, even if other ones are chained
+    // to it, and a multi-cycle one runs it for a few steps
+    bool isBusy(size_t index, uint32_t step) const {
+        return index < m_busy_until.size() && m_busy_until[index] >= step;
+    }
+
+    void use(size_t index, uint32_t last_step) {
+        m_busy_until[index] = last_step;
+    }
+
+    // index of a device of the pool owning given in port
+    std::optional<size_t> indexOf(dev::InPort::Id in) const {
+        auto id = util::asInt(in);
+        return id < m_index_by_in.size() ? m_index_by_in[id] : std::nullopt;
     }
 
-    void reset() {
-        m_unallocated = m_list.begin();
+    size_t size() const {
+        return m_index.size();
     }
 
     auto& list() const {
@@ -43,9 +74,12 @@ public:
     }
 
 private:
-    dev::Context& m_context;
+    std::function<D()> m_make;
     std::list<D> m_list;
-    decltype(m_list.begin()) m_unallocated;
+    std::vector<D*> m_index;
+    std::vector<std::optional<size_t>> m_index_by_in;
+    // the last step every device is used in
+    std::vector<uint32_t> m_busy_until;
 };
 
 template <typename D>
@@ -55,8 +89,11 @@ public:
         : m_context(context) {
     }
 
-    const auto& alloc(const std::string& name) {
-        return m_list.emplace_back(m_context.make<D>(name));
+    template <typename Arg>
+    const auto& alloc(const Arg& arg, uint32_t width) {
+        auto& dev = m_list.emplace_back(m_context.make<D>(arg));
+        dev.width = width;
+        return dev;
     }
 
     auto& list() const {
@@ -68,178 +105,718 @@ private:
     std::list<D> m_list;
 };
 
+// registers are numbered in order of creation, free ones are kept in a bitset
+// and the lowest of them is handed out first as in the left-edge algorithm
 class RegisterPool {
 public:
     RegisterPool(dev::Context& context)
         : m_context(context) {
     }
 
-    auto alloc() {
-        if (m_unallocated.empty()) {
-            auto reg = m_context.make<dev::Register>();
-            return m_regs.emplace(reg, reg).first->second.id;
+    uint32_t alloc() {
+        if (auto index = m_free.first()) {
+            m_free.erase(*index);
+            return *index;
         }
-        auto reg = m_unallocated.front();
-        m_unallocated.pop();
-        return reg;
+        m_list.push_back(m_context.make<dev::Register>());
+        return m_list.size() - 1;
+    }
+
+    bool isFree(uint32_t index) const {
+        return m_free.contains(index);
+    }
+
+    // takes particular register if it is free
+    bool take(uint32_t index) {
+        if (!isFree(index))
+            return false;
+        m_free.erase(index);
+        return true;
+    }
+
+    void put(uint32_t index) {
+        m_free.insert(index);
+    }
+
+    void widen(uint32_t index, uint32_t width) {
+        m_list[index].width = std::max(m_list[index].width, width);
+    }
+
+    auto regs() const {
+        std::unordered_map<dev::DeviceId, dev::Register> regs;
+        for (auto& reg : m_list)
+            regs.emplace(reg.id, reg);
+        return regs;
+    }
+
+    auto& reg(uint32_t index) const {
+        return m_list[index];
+    }
+
+private:
+    dev::Context& m_context;
+    std::vector<dev::Register> m_list;
+    util::BitSet m_free;
+};
+
+// rows are assigned to distinct columns with the minimum total cost by the
+// Hungarian algorithm, there should be no more rows than columns
+std::vector<uint32_t> minCostAssignment(const std::vector<int>& cost, size_t rows, size_t columns) {
+    assert(rows <= columns && cost.size() == rows * columns);
+    const int INF = std::numeric_limits<int>::max() / 2;
+    // potentials and matching are 1-based, zero column is a fake one
+    std::vector<int> u(rows + 1), v(columns + 1);
+    std::vector<size_t> row_by_column(columns + 1), way(columns + 1);
+    for (size_t row = 1; row <= rows; ++row) {
+        row_by_column[0] = row;
+        size_t column = 0;
+        std::vector<int> min_slack(columns + 1, INF);
+        std::vector<bool> used(columns + 1, false);
+        do {
+            used[column] = true;
+            auto current = row_by_column[column];
+            auto delta = INF;
+            size_t next = 0;
+            for (size_t j = 1; j <= columns; ++j) {
+                if (used[j])
+                    continue;
+                auto slack = cost[(current - 1) * columns + j - 1] - u[current] - v[j];
+                if (slack < min_slack[j]) {
+                    min_slack[j] = slack;
+                    way[j] = column;
+                }
+                if (min_slack[j] < delta) {
+                    delta = min_slack[j];
+                    next = j;
+                }
+            }
+            for (size_t j = 0; j <= columns; ++j) {
+                if (used[j]) {
+                    u[row_by_column[j]] += delta;
+                    v[j] -= delta;
+                }
+                else
+                    min_slack[j] -= delta;
+            }
+            column = next;
+        } while (row_by_column[column] != 0);
+        do {
+            auto prev = way[column];
+            row_by_column[column] = row_by_column[prev];
+            column = prev;
+        } while (column != 0);
     }
+    std::vector<uint32_t> column_by_row(rows);
+    for (size_t j = 1; j <= columns; ++j)
+        if (row_by_column[j])
+            column_by_row[row_by_column[j] - 1] = j - 1;
+    return column_by_row;
+}
 
-    void put(dev::DeviceId reg) {
-        m_unallocated.push(reg);
+// constant multipliers are pooled by their values
+class ConstMultiplierPools {
+public:
+    ConstMultiplierPools(dev::Context& context)
+        : m_context(context) {
     }
 
-    auto& regs() const {
-        return m_regs;
+    auto& operator[](uint64_t value) {
+        return m_pools.try_emplace(value, m_context, value).first->second;
     }
 
-    auto& reg(dev::DeviceId id) {
-        return m_regs.at(id);
+    auto list() const {
+        std::list<dev::ConstMultiplier> list;
+        for (auto& [value, pool] : m_pools)
+            list.insert(list.end(), pool.list().begin(), pool.list().end());
+        return list;
     }
 
 private:
     dev::Context& m_context;
-    std::queue<dev::DeviceId> m_unallocated;
-    std::unordered_map<dev::DeviceId, dev::Register> m_regs;
+    std::map<uint64_t, DevicePool<dev::ConstMultiplier>> m_pools;
 };
 
+// functional units are as wide as the widest operation bound to them
+template <typename Device>
+Device& widen(Device& device, const Instruction& instr) {
+    device.width = std::max(device.width, instr.width);
+    return device;
+}
+
+// the i-th source of an operation, swapped operands are taken in reverse order
+const Operand& sourceOf(const Instruction& instr, size_t i, bool swap) {
+    return instr.src[swap ? instr.src.size() - 1 - i : i];
+}
+
 class DeviceAllocator {
 public:
-    DeviceAllocator(dev::Context& context, const std::multimap<uint32_t, std::reference_wrapper<const Instruction>>& schedule, const std::unordered_map<Operand::Id, const std::string>& name_by_oper)
+    DeviceAllocator(dev::Context& context, const Schedule& schedule, const NameTable& names, const AllocOptions& options)
         : m_context(context)
         , m_inputs(context)
         , m_outputs(context)
+        , m_constants(context)
         , m_adders(context)
-        , m_multipliers(context)
+        , m_multipliers(context, schedule.timing().mul_latency, schedule.timing().pipelined_mul)
+        , m_const_multipliers(context)
         , m_regs(context)
+        , m_last_use(schedule.sequence().operandCount(), 0)
+        , m_last_used_at(schedule.lastStep() + 1)
+        , m_ready_at(schedule.lastStep() + 1)
+        , m_def_step(schedule.sequence().operandCount(), 0)
+        , m_chain_level(schedule.sequence().operandCount(), 0)
+        , m_reg_mapping(schedule.sequence().operandCount())
+        , m_fed_by_reg(schedule.sequence().operandCount())
+        , m_fed_by_input(schedule.sequence().operandCount())
+        , m_fed_by_unit(schedule.sequence().operandCount())
         , m_schedule(schedule)
-        , m_name_by_oper(name_by_oper) {
+        , m_names(names)
+        , m_options(options)
+        , m_drivers(schedule.lastStep() + 1) {
     }
 
     DataPath doIt() {
-        allocateRegisters();
-        allocateDevices();
-        return DataPath{m_inputs.list(), m_outputs.list(), m_adders.list(), m_multipliers.list(), m_regs.regs(), m_driver_list};
+        findLifetimes();
+        for (uint32_t step = 0; step <= m_schedule.lastStep(); ++step) {
+            releaseRegisters(step);
+            allocateDevices(step);
+        }
+        for (auto& drivers : m_drivers)
+            std::sort(drivers.begin(), drivers.end(), [](auto& a, auto& b) {
+                return a.in < b.in;
+            });
+        return DataPath{m_inputs.list(), m_outputs.list(), m_constants.list(), m_adders.list(), m_multipliers.list(), m_const_multipliers.list(),
+                        m_regs.regs(), std::move(m_drivers)};
     }
 
 private:
-    void allocateDevices();
-    void allocateRegisters();
+    // operations of a step which are bound to devices of a pool in one go
+    using Operations = std::vector<const Instruction*>;
+
+    void findLifetimes();
+    void releaseRegisters(uint32_t);
+    void allocateDevices(uint32_t);
     template <typename Device>
-    void mapIn(uint32_t, const Instruction&, const Device&);
+    void bindOperations(uint32_t, const Operations&, DevicePool<Device>&);
     template <typename Device>
-    void mapOut(uint32_t, const Instruction&, const Device&);
+    int bindingCost(uint32_t, const Instruction&, const Device&);
     template <typename Device>
-    void mapIo(uint32_t, const Instruction&, const Device&);
+    uint32_t newConnections(uint32_t, const Instruction&, const Device&, bool);
+    uint32_t allocateRegister(const Instruction&, dev::OutPort::Id);
+    dev::OutPort::Id source(uint32_t, const Operand&);
+    bool connected(dev::InPort::Id, dev::OutPort::Id) const;
+    void connect(uint32_t, dev::InPort::Id, dev::OutPort::Id);
+    template <typename Device>
+    void mapIn(uint32_t, const Instruction&, const Device&, bool);
+    void mapOut(uint32_t, const Instruction&, dev::OutPort::Id);
+    template <typename Device>
+    void mapIo(uint32_t, const Instruction&, const Device&, bool = false);
 
     const std::string& inputName(const Instruction&);
     const std::string& outputName(const Instruction&);
 
+    // above it binding falls back to greedy choice of the cheapest device
+    static constexpr size_t MAX_MATCHING_SIZE = 64;
+    // cost of binding to a device which is busy in the step, more than any real one
+    static constexpr int BUSY_COST = 1 << 20;
+
     dev::Context& m_context;
     IoPool<dev::Input> m_inputs;
     IoPool<dev::Output> m_outputs;
+    IoPool<dev::Constant> m_constants;
     DevicePool<dev::Adder> m_adders;
     DevicePool<dev::Multiplier> m_multipliers;
+    ConstMultiplierPools m_const_multipliers;
     RegisterPool m_regs;
-    std::unordered_map<Operand::Id, dev::DeviceId> m_reg_mapping;
-    std::unordered_map<Operand::Id, dev::OutPort::Id> m_fed_by_reg;
-    std::unordered_map<Operand::Id, dev::OutPort::Id> m_fed_by_input;
-    const std::multimap<uint32_t, std::reference_wrapper<const Instruction>>& m_schedule;
-    const std::unordered_map<Operand::Id, const std::string>& m_name_by_oper;
-    std::map<std::tuple<uint32_t, dev::InPort::Id>, dev::OutPort::Id> m_driver_list;
+    // tables below are indexed by operand id
+    std::vector<uint32_t> m_last_use;
+    // values by the step they are used last in
+    std::vector<std::vector<uint32_t>> m_last_used_at;
+    // results of multi-cycle operations by the step they are ready at
+    std::vector<std::vector<std::pair<const Instruction*, dev::OutPort::Id>>> m_ready_at;
+    // step the value is ready at, zero for inputs and constants
+    std::vector<uint32_t> m_def_step;
+    // length of the chain of operations of the same step computing the value
+    std::vector<uint32_t> m_chain_level;
+    std::vector<std::optional<uint32_t>> m_reg_mapping;
+    std::vector<std::optional<dev::OutPort::Id>> m_fed_by_reg;
+    std::vector<std::optional<dev::OutPort::Id>> m_fed_by_input;
+    std::vector<std::optional<dev::OutPort::Id>> m_fed_by_unit;
+    // out ports connected to every in port, indexed by in port id
+    std::vector<std::vector<dev::OutPort::Id>> m_sources;
+    // in ports connected to every out port, indexed by out port id
+    std::vector<std::vector<dev::InPort::Id>> m_sinks;
+    // registers written from every out port, indexed by out port id
+    std::vector<std::vector<uint32_t>> m_written_regs;
+    const Schedule& m_schedule;
+    const NameTable& m_names;
+    const AllocOptions& m_options;
+    std::vector<std::vector<Driver>> m_drivers;
 };
 
-template <typename Device>
-void DeviceAllocator::mapIn(uint32_t step, const Instruction& instr, const Device& device) {
-    assert(instr.src.size() == device.in.size());
-    for (size_t i = 0; i < instr.src.size(); ++i) {
-        auto& op = instr.src[i];
-        auto& in = device.in[i];
-        // at first step in ports feed devices directly, later everything are fed by regs
-        auto& m_fed_by = (step == 1) ? m_fed_by_input : m_fed_by_reg;
-        m_driver_list.emplace(std::make_tuple(step, in), m_fed_by.at(op));
-    }
+dev::OutPort::Id DeviceAllocator::source(uint32_t step, const Operand& op) {
+    // operations chained in a step are fed by the devices computing their operands
+    if (m_def_step[util::asInt(op.id)] == step)
+        return m_fed_by_unit[util::asInt(op.id)].value();
+    // at first step in ports feed devices directly, later everything are fed by regs
+    auto& m_fed_by = (step == 1) ? m_fed_by_input : m_fed_by_reg;
+    return m_fed_by[util::asInt(op.id)].value();
 }
 
-template <>
-void DeviceAllocator::mapOut(uint32_t step, const Instruction& instr, const dev::Output&) {
+bool DeviceAllocator::connected(dev::InPort::Id in, dev::OutPort::Id out) const {
+    auto index = util::asInt(in);
+    if (index >= m_sources.size())
+        return false;
+    auto& sources = m_sources[index];
+    return std::find(sources.begin(), sources.end(), out) != sources.end();
+}
+
+void DeviceAllocator::connect(uint32_t step, dev::InPort::Id in, dev::OutPort::Id out) {
+    m_drivers[step].push_back(Driver{in, out});
+    if (connected(in, out))
+        return;
+    auto index = util::asInt(in);
+    if (index >= m_sources.size())
+        m_sources.resize(index + 1);
+    m_sources[index].push_back(out);
+    index = util::asInt(out);
+    if (index >= m_sinks.size())
+        m_sinks.resize(index + 1);
+    m_sinks[index].push_back(in);
 }
 
 template <typename Device>
-void DeviceAllocator::mapOut(uint32_t step, const Instruction& instr, const Device& device) {
+void DeviceAllocator::mapIn(uint32_t step, const Instruction& instr, const Device& device, bool swap) {
+    assert(instr.src.size() == device.in.size());
+    for (size_t i = 0; i < instr.src.size(); ++i)
+        connect(step, device.in[i], source(step, sourceOf(instr, i, swap)));
+}
+
+void DeviceAllocator::mapOut(uint32_t step, const Instruction& instr, dev::OutPort::Id out) {
     if (!instr.dst)
         return;
-    auto& dst = *instr.dst;
-    auto it = m_reg_mapping.find(dst);
-    if (it == m_reg_mapping.end()) {
-        assert(instr.opcode == Opcode::INPUT && step == 0);
-        m_fed_by_input.emplace(dst, device.out);
+    auto dst = util::asInt(instr.dst->id);
+    // constants feed devices directly at every step and need no registers
+    if (instr.opcode == Opcode::CONST) {
+        m_fed_by_input[dst] = m_fed_by_reg[dst] = out;
+        return;
     }
-    else {
-        auto& reg = m_regs.reg(it->second);
-        // zero step is not really exists, so assignment should be done in first one
-        m_driver_list.emplace(std::make_tuple(std::max(step,  1u), reg.in[0]), device.out);
-        m_fed_by_reg.emplace(dst, reg.out);
+    // inputs feed first step directly even when their values are kept in registers for later ones
+    if (instr.opcode == Opcode::INPUT)
+        m_fed_by_input[dst] = out;
+    else
+        m_fed_by_unit[dst] = out;
+    // zero step is not really exists, so assignment should be done in first one,
+    // values only read in the step they are made in need no registers
+    step = std::max(step, 1u);
+    if (m_last_use[dst] <= step)
+        return;
+    auto index = allocateRegister(instr, out);
+    m_regs.widen(index, instr.width);
+    m_reg_mapping[dst] = index;
+    auto& reg = m_regs.reg(index);
+    if (!connected(reg.in[0], out)) {
+        if (util::asInt(out) >= m_written_regs.size())
+            m_written_regs.resize(util::asInt(out) + 1);
+        m_written_regs[util::asInt(out)].push_back(index);
     }
+    connect(step, reg.in[0], out);
+    m_fed_by_reg[dst] = reg.out;
 }
 
+// a multi-cycle unit is fed by operands in every step it is busy in and its
+// result is written once ready
 template <typename Device>
-void DeviceAllocator::mapIo(uint32_t step, const Instruction& instr, const Device& device) {
-    mapIn(step, instr, device);
-    mapOut(step, instr, device);
+void DeviceAllocator::mapIo(uint32_t step, const Instruction& instr, const Device& device, bool swap) {
+    for (uint32_t busy = 0; busy < m_schedule.timing().busy(instr); ++busy)
+        mapIn(step + busy, instr, device, swap);
+    if constexpr (!std::is_same_v<Device, dev::Output>) {
+        auto ready = step + m_schedule.timing().latency(instr) - 1;
+        if (ready == step)
+            mapOut(step, instr, device.out);
+        else
+            m_ready_at[ready].emplace_back(&instr, device.out);
+    }
 }
 
 const std::string& DeviceAllocator::inputName(const Instruction& input) {
-    return m_name_by_oper.at(input.dst.value());
+    return m_names.inputs.at(input.dst.value());
 }
 
 const std::string& DeviceAllocator::outputName(const Instruction& output) {
-    return m_name_by_oper.at(output.src.at(0));
+    return m_names.outputs.at(output.id);
 }
 
-void DeviceAllocator::allocateDevices() {
-    auto last_step = m_schedule.rbegin()->first;
-    for (uint32_t step = 0; step <= last_step; ++step) {
-        m_adders.reset();
-        m_multipliers.reset();
-        for (auto p : m_schedule.equal_range(step)) {
-            const Instruction& instr = p.second;
+template <typename Device>
+uint32_t DeviceAllocator::newConnections(uint32_t step, const Instruction& instr, const Device& device, bool swap) {
+    uint32_t count = 0;
+    for (size_t i = 0; i < device.in.size(); ++i)
+        count += !connected(device.in[i], source(step, sourceOf(instr, i, swap)));
+    return count;
+}
+
+template <typename Device>
+int DeviceAllocator::bindingCost(uint32_t step, const Instruction& instr, const Device& device) {
+    // every new connection adds an input to a multiplexer, operands are swapped
+    // when it saves one and the result is better written to a free register
+    // the device already writes to
+    auto cost = std::min(newConnections(step, instr, device, false), newConnections(step, instr, device, true));
+    auto out = util::asInt(device.out.id);
+    if (out >= m_written_regs.size())
+        return cost + 1;
+    auto& regs = m_written_regs[out];
+    auto free = std::any_of(regs.begin(), regs.end(), [&](auto index) {
+        return m_regs.isFree(index);
+    });
+    return cost + !free;
+}
+
+template <typename Device>
+void DeviceAllocator::bindOperations(uint32_t step, const Operations& instrs, DevicePool<Device>& pool) {
+    auto rows = instrs.size();
+    // devices running operations chained before these ones are left out
+    size_t busy = 0;
+    for (size_t column = 0; column < pool.size(); ++column)
+        busy += pool.isBusy(column, step);
+    auto columns = std::max(rows + busy, pool.size());
+    util::BitSet free;
+    for (size_t column = 0; column < columns; ++column)
+        if (!pool.isBusy(column, step))
+            free.insert(column);
+    // otherwise i-th operation of a step goes to i-th device
+    std::vector<uint32_t> column_by_row(rows);
+    for (size_t row = 0, column = 0; row < rows; ++row, ++column) {
+        column = *free.next(column);
+        column_by_row[row] = column;
+    }
+    if (m_options.interconnect_aware && rows <= MAX_MATCHING_SIZE) {
+        std::vector<int> cost(rows * columns);
+        for (size_t row = 0; row < rows; ++row)
+            for (size_t column = 0; column < columns; ++column)
+                cost[row * columns + column] = free.contains(column) ? bindingCost(step, *instrs[row], pool.at(column)) : BUSY_COST;
+        column_by_row = minCostAssignment(cost, rows, columns);
+    }
+    else if (m_options.interconnect_aware) {
+        // only devices already fed by operands can do better than a free one
+        for (size_t row = 0; row < rows; ++row) {
+            auto& instr = *instrs[row];
+            auto best = *free.first();
+            auto best_cost = bindingCost(step, instr, pool.at(best));
+            for (auto& src : instr.src) {
+                auto out = util::asInt(source(step, src));
+                if (out >= m_sinks.size())
+                    continue;
+                for (auto in : m_sinks[out]) {
+                    auto column = pool.indexOf(in);
+                    if (!column || !free.contains(*column))
+                        continue;
+                    auto cost = bindingCost(step, instr, pool.at(*column));
+                    if (cost < best_cost || (cost == best_cost && *column < best)) {
+                        best = *column;
+                        best_cost = cost;
+                    }
+                }
+            }
+            free.erase(best);
+            column_by_row[row] = best;
+        }
+    }
+    for (size_t row = 0; row < rows; ++row) {
+        auto& instr = *instrs[row];
+        auto& device = widen(pool.at(column_by_row[row]), instr);
+        pool.use(column_by_row[row], step + m_schedule.timing().busy(instr) - 1);
+        auto swap = m_options.interconnect_aware && newConnections(step, instr, device, true) < newConnections(step, instr, device, false);
+        mapIo(step, instr, device, swap);
+    }
+}
+
+void DeviceAllocator::allocateDevices(uint32_t step) {
+    auto& sequence = m_schedule.sequence();
+    for (auto [instr, out] : m_ready_at[step])
+        mapOut(step, *instr, out);
+    // operations chained to others of the step are bound after them, so that
+    // devices feeding them are known, i.e. level by level of chains
+    struct Level {
+        Operations adds;
+        Operations muls;
+        std::map<uint64_t, Operations> mulcs;
+    };
+    std::vector<Level> levels(1);
+    for (auto id : m_schedule.at(step)) {
+        auto& instr = sequence[id];
+        uint32_t level = 0;
+        for (auto& src : instr.src)
+            if (m_def_step[util::asInt(src.id)] == step)
+                level = std::max(level, m_chain_level[util::asInt(src.id)] + 1);
+        if (instr.dst)
+            m_chain_level[util::asInt(instr.dst->id)] = level;
+        if (level >= levels.size())
+            levels.resize(level + 1);
+        switch (instr.opcode) {
+        case Opcode::ADD:
+            levels[level].adds.push_back(&instr);
+            break;
+        case Opcode::MUL:
+            levels[level].muls.push_back(&instr);
+            break;
+        case Opcode::MULC:
+            levels[level].mulcs[instr.value].push_back(&instr);
+            break;
+        case Opcode::INPUT:
+            mapIo(step, instr, m_inputs.alloc(inputName(instr), instr.width));
+            break;
+        case Opcode::CONST:
+            mapIo(step, instr, m_constants.alloc(instr.value, instr.width));
+            break;
+        case Opcode::OUTPUT:
+            mapIo(step, instr, m_outputs.alloc(outputName(instr), instr.width));
+        }
+    }
+    for (auto& level : levels) {
+        bindOperations(step, level.adds, m_adders);
+        bindOperations(step, level.muls, m_multipliers);
+        for (auto& [value, instrs] : level.mulcs)
+            bindOperations(step, instrs, m_const_multipliers[value]);
+    }
+}
+
+void DeviceAllocator::findLifetimes() {
+    auto& sequence = m_schedule.sequence();
+    for (uint32_t step = 0; step <= m_schedule.lastStep(); ++step)
+        for (auto id : m_schedule.at(step)) {
+            auto& instr = sequence[id];
+            auto last = step + m_schedule.timing().busy(instr) - 1;
+            for (auto& src : instr.src)
+                m_last_use[util::asInt(src.id)] = std::max(m_last_use[util::asInt(src.id)], last);
+            if (instr.dst && instr.opcode != Opcode::INPUT && instr.opcode != Opcode::CONST)
+                m_def_step[util::asInt(instr.dst->id)] = m_schedule.readyAt(instr);
+        }
+    for (auto& instr : sequence)
+        if (instr.dst)
+            m_last_used_at[m_last_use[util::asInt(instr.dst->id)]].push_back(util::asInt(instr.dst->id));
+}
+
+// a value lives in a register from the end of the step it is written in
+// up to the last step reading it, so lifetimes are intervals over steps:
+// they are taken in order of their start and a register is released as
+// soon as its value is read for the last time, what keeps the number of
+// registers equal to the maximum number of values live at once
+void DeviceAllocator::releaseRegisters(uint32_t step) {
+    for (auto id : m_last_used_at[step])
+        if (auto& reg = m_reg_mapping[id])
+            m_regs.put(*reg);
+}
+
+uint32_t DeviceAllocator::allocateRegister(const Instruction& instr, dev::OutPort::Id out) {
+    // any free register keeps the count minimal, so the one already written
+    // from the same port is preferred, then a register of an operand
+    if (m_options.interconnect_aware && util::asInt(out) < m_written_regs.size())
+        for (auto index : m_written_regs[util::asInt(out)])
+            if (m_regs.take(index))
+                return index;
+    for (auto& src : instr.src) {
+        auto& reg = m_reg_mapping[util::asInt(src.id)];
+        if (reg && m_regs.take(*reg))
+            return *reg;
+    }
+    return m_regs.alloc();
+}
+
+// a pipelined data path runs an operation at the phase of its step and starts
+// a new iteration every II cycles, so values living longer get overwritten by
+// next iterations unless kept in a chain of ceil(lifetime / II) registers:
+// a new value is written to the head of the chain and older ones are shifted
+// along it, all at the phase the value is written in
+class PipelineAllocator {
+public:
+    PipelineAllocator(dev::Context& context, const Schedule& schedule, const NameTable& names)
+        : m_inputs(context)
+        , m_outputs(context)
+        , m_constants(context)
+        , m_adders(context)
+        , m_multipliers(context, schedule.timing().mul_latency, schedule.timing().pipelined_mul)
+        , m_const_multipliers(context)
+        , m_regs(context)
+        , m_written(schedule.sequence().operandCount(), 0)
+        , m_last_use(schedule.sequence().operandCount(), 0)
+        , m_constant(schedule.sequence().operandCount())
+        , m_chain(schedule.sequence().operandCount())
+        , m_fed_by_input(schedule.sequence().operandCount())
+        , m_fed_by_unit(schedule.sequence().operandCount())
+        , m_schedule(schedule)
+        , m_names(names)
+        , m_drivers(schedule.initiationInterval() + 2) {
+    }
+
+    DataPath doIt() {
+        allocateRegisters();
+        allocateDevices();
+        for (auto& drivers : m_drivers)
+            std::sort(drivers.begin(), drivers.end(), [](auto& a, auto& b) {
+                return a.in < b.in;
+            });
+        return DataPath{m_inputs.list(), m_outputs.list(), m_constants.list(), m_adders.list(), m_multipliers.list(), m_const_multipliers.list(),
+                        m_regs.regs(), std::move(m_drivers), m_schedule.initiationInterval(), m_schedule.latency()};
+    }
+
+private:
+    void allocateRegisters();
+    void allocateDevices();
+    uint32_t state(uint32_t step) const;
+    dev::OutPort::Id source(uint32_t, const Operand&);
+    template <typename Device>
+    void mapIo(uint32_t, const Instruction&, const Device&);
+
+    IoPool<dev::Input> m_inputs;
+    IoPool<dev::Output> m_outputs;
+    IoPool<dev::Constant> m_constants;
+    DevicePool<dev::Adder> m_adders;
+    DevicePool<dev::Multiplier> m_multipliers;
+    ConstMultiplierPools m_const_multipliers;
+    RegisterPool m_regs;
+    // tables below are indexed by operand id
+    std::vector<uint32_t> m_written;
+    std::vector<uint32_t> m_last_use;
+    std::vector<bool> m_constant;
+    // first register and length of a chain
+    std::vector<std::pair<uint32_t, uint32_t>> m_chain;
+    std::vector<std::optional<dev::OutPort::Id>> m_fed_by_input;
+    std::vector<std::optional<dev::OutPort::Id>> m_fed_by_unit;
+    const Schedule& m_schedule;
+    const NameTable& m_names;
+    std::vector<std::vector<Driver>> m_drivers;
+};
+
+// states are phases counted from one, the last one only drives outputs
+uint32_t PipelineAllocator::state(uint32_t step) const {
+    if (step == m_schedule.lastStep())
+        return m_schedule.initiationInterval() + 1;
+    // zero step is not really exists, inputs are taken in first one
+    return m_schedule.phaseOf(std::max(step, 1u)) + 1;
+}
+
+dev::OutPort::Id PipelineAllocator::source(uint32_t step, const Operand& op) {
+    auto id = util::asInt(op.id);
+    // operations chained in a step are fed by the devices computing their operands
+    if (m_fed_by_unit[id] && m_written[id] == step)
+        return *m_fed_by_unit[id];
+    // constants have no chains and feed devices directly at every step
+    if (step == 1 || m_constant[id])
+        return m_fed_by_input[id].value();
+    // the value was shifted along the chain by every write since its own one
+    auto ii = m_schedule.initiationInterval();
+    auto [first, length] = m_chain[id];
+    auto shifts = (step - m_written[id] + ii - 1) / ii - 1;
+    assert(shifts < length);
+    return m_regs.reg(first + shifts).out;
+}
+
+template <typename Device>
+void PipelineAllocator::mapIo(uint32_t step, const Instruction& instr, const Device& device) {
+    for (size_t i = 0; i < instr.src.size(); ++i)
+        m_drivers[state(step)].push_back(Driver{device.in[i], source(step, instr.src[i])});
+    if constexpr (!std::is_same_v<Device, dev::Output>) {
+        if (!instr.dst)
+            return;
+        auto dst = util::asInt(instr.dst->id);
+        if (instr.opcode == Opcode::INPUT || instr.opcode == Opcode::CONST)
+            m_fed_by_input[dst] = device.out;
+        else
+            m_fed_by_unit[dst] = device.out;
+        auto [first, length] = m_chain[dst];
+        auto out = device.out.id;
+        for (auto index = first; index < first + length; ++index) {
+            auto& reg = m_regs.reg(index);
+            m_drivers[state(m_written[dst])].push_back(Driver{reg.in[0], out});
+            out = reg.out.id;
+        }
+    }
+}
+
+void PipelineAllocator::allocateRegisters() {
+    auto& sequence = m_schedule.sequence();
+    for (uint32_t step = 0; step <= m_schedule.lastStep(); ++step)
+        for (auto id : m_schedule.at(step)) {
+            auto& instr = sequence[id];
+            for (auto& src : instr.src)
+                m_last_use[util::asInt(src.id)] = step;
+            if (instr.dst)
+                m_written[util::asInt(instr.dst->id)] = std::max(m_schedule.readyAt(instr), 1u);
+            if (instr.opcode == Opcode::CONST)
+                m_constant[util::asInt(instr.dst->id)] = true;
+        }
+    // nothing is freed, so registers of a chain go one after another
+    auto ii = m_schedule.initiationInterval();
+    for (auto& instr : sequence) {
+        if (!instr.dst)
+            continue;
+        auto dst = util::asInt(instr.dst->id);
+        if (m_constant[dst] || m_last_use[dst] <= m_written[dst])
+            continue;
+        auto length = (m_last_use[dst] - m_written[dst] + ii - 1) / ii;
+        m_chain[dst] = {m_regs.alloc(), length};
+        for (uint32_t i = 1; i < length; ++i)
+            m_regs.alloc();
+        for (uint32_t i = 0; i < length; ++i)
+            m_regs.widen(m_chain[dst].first + i, instr.width);
+    }
+}
+
+void PipelineAllocator::allocateDevices() {
+    auto& sequence = m_schedule.sequence();
+    // devices are taken in order within a phase as all its steps run at once
+    std::vector<std::array<uint32_t, 2>> used(m_schedule.initiationInterval());
+    std::map<std::pair<uint32_t, uint64_t>, uint32_t> used_mulcs;
+    for (uint32_t step = 0; step <= m_schedule.lastStep(); ++step)
+        for (auto id : m_schedule.at(step)) {
+            auto& instr = sequence[id];
             switch (instr.opcode) {
             case Opcode::ADD:
-                mapIo(step, instr, m_adders.alloc());
+                mapIo(step, instr, widen(m_adders.at(used[m_schedule.phaseOf(step)][0]++), instr));
                 break;
             case Opcode::MUL:
-                mapIo(step, instr, m_multipliers.alloc());
+                mapIo(step, instr, widen(m_multipliers.at(used[m_schedule.phaseOf(step)][1]++), instr));
+                break;
+            case Opcode::MULC:
+                mapIo(step, instr, widen(m_const_multipliers[instr.value].at(used_mulcs[{m_schedule.phaseOf(step), instr.value}]++), instr));
                 break;
             case Opcode::INPUT:
-                mapIo(step, instr, m_inputs.alloc(inputName(instr)));
+                mapIo(step, instr, m_inputs.alloc(m_names.inputs.at(instr.dst.value()), instr.width));
+                break;
+            case Opcode::CONST:
+                mapIo(step, instr, m_constants.alloc(instr.value, instr.width));
                 break;
             case Opcode::OUTPUT:
-                mapIo(step, instr, m_outputs.alloc(outputName(instr)));
+                mapIo(step, instr, m_outputs.alloc(m_names.outputs.at(instr.id), instr.width));
             }
         }
-    }
-}
-
-void DeviceAllocator::allocateRegisters() {
-    // zero step contains only INPUT instructions
-    // first step instructions are fed by ports
-    auto last_step = m_schedule.rbegin()->first;
-    for (auto step = last_step; step > 1; --step)
-        for (auto p : m_schedule.equal_range(step)) {
-            const Instruction& instr = p.second;
-            if (instr.dst)
-                m_regs.put(m_reg_mapping.at(*instr.dst));
-            for (auto& src : instr.src)
-                if (m_reg_mapping.find(src) == m_reg_mapping.end())
-                    m_reg_mapping.emplace(src, m_regs.alloc());
-        }
 }
 
 } // namespace
 
-DataPath allocate(const std::multimap<uint32_t, std::reference_wrapper<const Instruction>>& schedule, const std::unordered_map<Operand::Id, const std::string>& name_by_oper) {
+uint32_t countMuxInputs(const DataPath& data_path) {
+    std::vector<std::pair<dev::InPort::Id, dev::OutPort::Id>> connections;
+    for (auto& drivers : data_path.drivers)
+        for (auto& driver : drivers)
+            connections.emplace_back(driver.in, driver.out);
+    std::sort(connections.begin(), connections.end());
+    connections.erase(std::unique(connections.begin(), connections.end()), connections.end());
+    uint32_t count = 0;
+    for (size_t i = 0; i < connections.size();) {
+        auto j = i;
+        while (j < connections.size() && connections[j].first == connections[i].first)
+            ++j;
+        if (j - i > 1)
+            count += j - i;
+        i = j;
+    }
+    return count;
+}
+
+DataPath allocate(const Schedule& schedule, const NameTable& names, const AllocOptions& options) {
     exprc::dev::Context context;
-    exprc::DeviceAllocator allocator(context, schedule, name_by_oper);
+    if (schedule.initiationInterval())
+        return PipelineAllocator(context, schedule, names).doIt();
+    exprc::DeviceAllocator allocator(context, schedule, names, options);
     return allocator.doIt();
 }
 
@@ -0,0 +1,215 @@
+#include <exprc/batch.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <fmt/format.h>
+
+#include <exprc/source.h>
+
+namespace exprc {
+
+namespace batch {
+
+namespace {
+
+bool isDirectory(const std::string& path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode);
+}
+
+size_t fileSize(const std::string& path) {
+    struct stat st;
+    return ::stat(path.c_str(), &st) == 0 ? static_cast<size_t>(st.st_size) : 0;
+}
+
+bool endsWith(const std::string& str, const std::string& suffix) {
+    return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+std::string directoryOf(const std::string& path) {
+    auto slash = path.rfind('/');
+    return slash == std::string::npos ? std::string() : path.substr(0, slash + 1);
+}
+
+std::string join(const std::string& dir, const std::string& name) {
+    if (dir.empty() || (!name.empty() && name[0] == '/'))
+        return name;
+    return dir.back() == '/' ? dir + name : dir + '/' + name;
+}
+
+// the file name without its extension
+std::string stem(const std::string& path) {
+    auto name = path.substr(path.rfind('/') + 1);
+    auto dot = name.rfind('.');
+    return dot == std::string::npos || dot == 0 ? name : name.substr(0, dot);
+}
+
+std::vector<std::string> listDirectory(const std::string& path) {
+    auto* dir = ::opendir(path.c_str());
+    if (!dir)
+        throw std::invalid_argument(fmt::format("can not open {}: {}", path, std::strerror(errno)));
+    std::vector<std::string> files;
+    while (auto* entry = ::readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name[0] != '.' && endsWith(name, ".txt") && !isDirectory(join(path, name)))
+            files.push_back(join(path, name));
+    }
+    ::closedir(dir);
+    std::sort(files.begin(), files.end());
+    return files;
+}
+
+std::vector<std::string> readManifest(const std::string& path) {
+    auto source = Source::fromFile(path);
+    auto text = source.text();
+    std::vector<std::string> files;
+    while (!text.empty()) {
+        auto end = std::min(text.find('\n'), text.size());
+        auto line = text.substr(0, end);
+        text.remove_prefix(std::min(end + 1, text.size()));
+        line = line.substr(0, std::min(line.find('#'), line.size()));
+        auto first = line.find_first_not_of(" \t\r");
+        if (first == std::string_view::npos)
+            continue;
+        auto last = line.find_last_not_of(" \t\r");
+        files.push_back(join(directoryOf(path), std::string(line.substr(first, last - first + 1))));
+    }
+    return files;
+}
+
+// jobs of a worker by index, the worker pops them from the front while
+// others steal from the back
+class WorkQueue {
+public:
+    void push(size_t job) {
+        std::lock_guard lock(m_mutex);
+        m_jobs.push_back(job);
+    }
+
+    std::optional<size_t> pop() {
+        std::lock_guard lock(m_mutex);
+        if (m_jobs.empty())
+            return std::nullopt;
+        auto job = m_jobs.front();
+        m_jobs.pop_front();
+        return job;
+    }
+
+    std::optional<size_t> steal() {
+        std::lock_guard lock(m_mutex);
+        if (m_jobs.empty())
+            return std::nullopt;
+        auto job = m_jobs.back();
+        m_jobs.pop_back();
+        return job;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::deque<size_t> m_jobs;
+};
+
+Result runJob(const Job& job, const CompileOptions& options) {
+    Result result;
+    auto start = std::chrono::steady_clock::now();
+    try {
+        auto source = Source::fromFile(job.input);
+        auto compiled = compile(source.text(), options);
+        std::ofstream os(job.output, std::ios::binary);
+        os.write(compiled.output.data(), static_cast<std::streamsize>(compiled.output.size()));
+        if (!os.flush())
+            throw std::invalid_argument(fmt::format("can not write {}", job.output));
+    }
+    // running out of memory on one program should not take others down
+    catch (const std::exception& e) {
+        result.error = e.what();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+} // namespace
+
+std::vector<Job> jobs(const std::string& path, const std::string& output_dir, const std::string& extension) {
+    auto inputs = isDirectory(path) ? listDirectory(path) : readManifest(path);
+    std::vector<Job> jobs;
+    // paths are compared once made absolute with '.', '..' and symbolic
+    // links resolved, as far as they exist
+    auto canonical = [](const std::string& path) {
+        std::error_code error;
+        auto canonical = std::filesystem::weakly_canonical(path, error);
+        return error ? path : canonical.string();
+    };
+    std::unordered_map<std::string, std::string> written_by;
+    for (auto& input : inputs) {
+        auto output = join(output_dir.empty() ? directoryOf(input) : output_dir, stem(input) + extension);
+        auto written = canonical(output);
+        if (written == canonical(input))
+            throw std::invalid_argument(fmt::format("{} would be overwritten by its output", input));
+        auto [it, inserted] = written_by.emplace(written, input);
+        if (!inserted)
+            throw std::invalid_argument(fmt::format("{} and {} both write {}", it->second, input, output));
+        jobs.push_back({input, std::move(output)});
+    }
+    return jobs;
+}
+
+std::vector<Result> run(const std::vector<Job>& jobs, const CompileOptions& options, unsigned threads) {
+    validate(options);
+    std::vector<Result> results(jobs.size());
+    if (jobs.empty())
+        return results;
+    if (!threads)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = static_cast<unsigned>(std::min<size_t>(threads, jobs.size()));
+
+    // largest programs go first and are dealt out in turn, so that workers
+    // start with a like share and steal only small ones at the end
+    std::vector<std::pair<size_t, size_t>> by_size;
+    for (size_t i = 0; i < jobs.size(); ++i)
+        by_size.emplace_back(fileSize(jobs[i].input), i);
+    std::stable_sort(by_size.begin(), by_size.end(), [](auto& a, auto& b) {
+        return a.first > b.first;
+    });
+    std::vector<WorkQueue> queues(threads);
+    for (size_t i = 0; i < by_size.size(); ++i)
+        queues[i % threads].push(by_size[i].second);
+
+    // no job makes new ones, so a worker finding every queue empty is done
+    auto work = [&](unsigned worker) {
+        for (;;) {
+            auto job = queues[worker].pop();
+            for (unsigned i = 1; !job && i < threads; ++i)
+                job = queues[(worker + i) % threads].steal();
+            if (!job)
+                return;
+            results[*job] = runJob(jobs[*job], options);
+        }
+    };
+    std::vector<std::thread> pool;
+    for (unsigned worker = 1; worker < threads; ++worker)
+        pool.emplace_back(work, worker);
+    work(0);
+    for (auto& thread : pool)
+        thread.join();
+    return results;
+}
+
+} // namespace batch
+
+} // namespace exprc
@@ -0,0 +1,232 @@
+#include <exprc/cpp.h>
+
+#include <iterator>
+#include <optional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <exprc/eval.h>
+#include <exprc/util.h>
+
+namespace exprc {
+
+namespace cpp {
+
+namespace {
+
+// narrowest unsigned type holding width bits
+uint32_t typeWidth(uint32_t width) {
+    return width <= 8 ? 8 : width <= 16 ? 16 : width <= 32 ? 32 : 64;
+}
+
+std::string type(uint32_t width) {
+    return fmt::format("uint{}_t", typeWidth(width));
+}
+
+std::string literal(uint64_t value) {
+    return fmt::format("{}{}", value, value >> 32 ? "ull" : "u");
+}
+
+std::string mask(uint32_t width) {
+    return fmt::format("0x{:x}{}", width < 64 ? (uint64_t(1) << width) - 1 : ~uint64_t(0), width > 32 ? "ull" : "u");
+}
+
+// every value is kept in a temporary of the widest type, which stays in
+// a vector register, temporaries are reused once values in them are dead;
+// arrays are named after the program prefixed with in_ or out_, which keeps
+// them apart from C++ keywords and from names made here, those end with '_'
+// and do not start with either prefix
+class Dumper {
+public:
+    Dumper(std::ostream& os, const Sequence& sequence, const NameTable& names, const DumpOptions& options)
+        : m_os(os)
+        , m_sequence(sequence)
+        , m_names(names)
+        , m_options(options)
+        , m_slots(assignSlots(sequence))
+        , m_lane_width(laneWidth(sequence))
+        , m_widths(sequence.operandCount())
+        , m_constants(sequence.operandCount()) {
+        for (auto& instr : sequence) {
+            if (instr.dst)
+                m_widths[util::asInt(instr.dst->id)] = instr.width;
+            if (instr.opcode == Opcode::INPUT)
+                m_inputs.emplace_back("in_" + names.inputs.at(instr.dst->id), instr.width);
+            if (instr.opcode == Opcode::OUTPUT)
+                m_outputs.emplace_back("out_" + names.outputs.at(instr.id), instr.width);
+            if (instr.opcode == Opcode::CONST)
+                m_constants[util::asInt(instr.dst->id)] = instr.value;
+        }
+    }
+
+    // the whole file is formatted in memory and written at once
+    void dump() {
+        dumpKernel();
+        if (m_options.harness)
+            dumpHarness();
+        m_os.write(m_buf.data(), static_cast<std::streamsize>(m_buf.size()));
+    }
+
+private:
+    void dumpKernel() {
+        print("#include <cstddef>\n");
+        print("#include <cstdint>\n\n");
+        print("// arrays hold n_ elements, values wrap around at their widths\n");
+        print("void exprc(size_t n_");
+        for (auto& [name, width] : m_inputs)
+            print(",\n           const {}* __restrict {}", type(width), name);
+        for (auto& [name, width] : m_outputs)
+            print(",\n           {}* __restrict {}", type(width), name);
+        print(") {{\n");
+        print("    for (size_t i_ = 0; i_ < n_; ++i_) {{\n");
+        if (m_slots.count) {
+            print("        {} ", type(m_lane_width));
+            for (uint32_t slot = 0; slot < m_slots.count; ++slot)
+                print("{}t{}_", slot ? ", " : "", slot);
+            print(";\n");
+        }
+        for (auto& instr : m_sequence)
+            dumpInstr(instr);
+        print("    }}\n");
+        print("}}\n");
+    }
+
+    // results are cut to their widths unless the type does it
+    void dumpInstr(const Instruction& instr) {
+        auto& src = instr.src;
+        switch (instr.opcode) {
+        case Opcode::INPUT:
+            assign(instr, fmt::format("in_{}[i_]", m_names.inputs.at(instr.dst->id)), typeWidth(instr.width));
+            break;
+        case Opcode::OUTPUT: {
+            auto value = operand(src[0]);
+            if (m_widths[util::asInt(src[0].id)] > instr.width)
+                value = fmt::format("{} & {}", value, mask(instr.width));
+            print("        out_{}[i_] = {};\n", m_names.outputs.at(instr.id), value);
+            break;
+        }
+        case Opcode::CONST:
+            break;
+        case Opcode::ADD:
+            assign(instr, fmt::format("{} + {}", operand(src[0]), operand(src[1])), m_lane_width);
+            break;
+        case Opcode::MUL:
+            assign(instr, fmt::format("{} * {}", product(src[0]), operand(src[1])), m_lane_width);
+            break;
+        case Opcode::MULC:
+            assign(instr, fmt::format("{} * {}", product(src[0]), literal(instr.value)), m_lane_width);
+            break;
+        }
+    }
+
+    void assign(const Instruction& instr, const std::string& value, uint32_t type_width) {
+        if (instr.width < type_width)
+            print("        {} = ({}) & {};\n", temporary(*instr.dst), value, mask(instr.width));
+        else
+            print("        {} = {};\n", temporary(*instr.dst), value);
+    }
+
+    std::string temporary(const Operand& op) const {
+        return fmt::format("t{}_", m_slots.by_operand[util::asInt(op.id)]);
+    }
+
+    // constants are written in place
+    std::string operand(const Operand& op) const {
+        if (auto& value = m_constants[util::asInt(op.id)])
+            return literal(*value);
+        return temporary(op);
+    }
+
+    // 16 bit values are promoted to int, whose products overflow, while
+    // products of 8 bit values fit into it
+    std::string product(const Operand& op) const {
+        if (m_lane_width == 16)
+            return fmt::format("uint32_t({})", operand(op));
+        return operand(op);
+    }
+
+    // inputs are random values of their widths and outputs are folded into
+    // a checksum, so that runs of the same arrays can be compared
+    void dumpHarness() {
+        print("\n");
+        print("#include <chrono>\n");
+        print("#include <cstdio>\n");
+        print("#include <cstdlib>\n");
+        print("#include <vector>\n\n");
+        print("// runs exprc() over arrays of argv[1] elements, 1M by default, for a second\n");
+        print("int main(int argc_, char* argv_[]) {{\n");
+        print("    size_t n_ = argc_ > 1 ? std::strtoull(argv_[1], nullptr, 0) : 1 << 20;\n");
+        print("    uint64_t seed_ = 0x9e3779b97f4a7c15ull;\n");
+        print("    auto random_ = [&]() {{\n");
+        print("        seed_ ^= seed_ << 13;\n");
+        print("        seed_ ^= seed_ >> 7;\n");
+        print("        seed_ ^= seed_ << 17;\n");
+        print("        return seed_;\n");
+        print("    }};\n");
+        for (auto& [name, width] : m_inputs) {
+            print("    std::vector<{}> {}(n_);\n", type(width), name);
+            print("    for (auto& value_ : {})\n", name);
+            print("        value_ = {}(random_() & {});\n", type(width), mask(width));
+        }
+        for (auto& [name, width] : m_outputs)
+            print("    std::vector<{}> {}(n_);\n", type(width), name);
+        print("    auto run_ = [&]() {{\n");
+        print("        exprc(n_");
+        for (auto& input : m_inputs)
+            print(", {}.data()", input.first);
+        for (auto& output : m_outputs)
+            print(", {}.data()", output.first);
+        print(");\n");
+        print("    }};\n");
+        print("    run_();\n");
+        print("    size_t runs_ = 0;\n");
+        print("    std::chrono::duration<double> seconds_{{}};\n");
+        print("    auto start_ = std::chrono::steady_clock::now();\n");
+        print("    do {{\n");
+        print("        run_();\n");
+        print("        ++runs_;\n");
+        print("        seconds_ = std::chrono::steady_clock::now() - start_;\n");
+        print("    }} while (seconds_.count() < 1);\n");
+        print("    uint64_t checksum_ = 0;\n");
+        print("    for (size_t i_ = 0; i_ < n_; ++i_) {{\n");
+        for (auto& output : m_outputs)
+            print("        checksum_ = checksum_ * 0x100000001b3ull ^ {}[i_];\n", output.first);
+        print("    }}\n");
+        print("    std::printf(\"%zu elements x %zu runs: %.3f s, %.2fM elements/s, checksum %016llx\\n\", n_, runs_, seconds_.count(),\n");
+        print("                n_ * runs_ / seconds_.count() / 1e6, static_cast<unsigned long long>(checksum_));\n");
+        print("}}\n");
+    }
+
+    template <typename... Args>
+    void print(Args&&... args) {
+        fmt::format_to(std::back_inserter(m_buf), std::forward<Args>(args)...);
+    }
+
+    std::ostream& m_os;
+    const Sequence& m_sequence;
+    const NameTable& m_names;
+    const DumpOptions& m_options;
+    Slots m_slots;
+    uint32_t m_lane_width;
+    // widths of values by operand
+    std::vector<uint32_t> m_widths;
+    std::vector<std::optional<uint64_t>> m_constants;
+    // names of arrays and widths of their elements
+    std::vector<std::pair<std::string, uint32_t>> m_inputs;
+    std::vector<std::pair<std::string, uint32_t>> m_outputs;
+    fmt::memory_buffer m_buf;
+};
+
+} // namespace
+
+void dump(std::ostream& os, const Sequence& sequence, const NameTable& names, const DumpOptions& options) {
+    Dumper(os, sequence, names, options).dump();
+}
+
+} // namespace cpp
+
+} // namespace exprc
@@ -1,7 +1,10 @@
 #include <exprc/dfg.h>
 
-#include <functional>
-#include <iostream>
+#include <cstdint>
+#include <numeric>
+#include <stdexcept>
+#include <utility>
+#include <vector>
 
 #include <fmt/format.h>
 #include <fmt/ostream.h>
@@ -10,23 +13,85 @@
 
 namespace exprc {
 
-Dfg::Dfg(const std::list<Instruction>& seq) {
+namespace {
+
+constexpr auto UNDEFINED = static_cast<Instruction::Id>(~0u);
+
+} // namespace
+
+Dfg::Dfg(const Sequence& seq)
+    : m_sequence(&seq)
+    , m_defined_by(seq.operandCount(), UNDEFINED)
+    , m_use_begin(seq.operandCount() + 1)
+    , m_pred_begin(seq.size() + 1) {
     for (auto& instr : seq) {
+        m_pred_begin[util::asInt(instr.id) + 1] = static_cast<uint32_t>(instr.src.size());
+        for (auto& op : instr.src)
+            ++m_use_begin[util::asInt(op.id) + 1];
+        if (!instr.dst)
+            continue;
+        auto& def = m_defined_by[util::asInt(instr.dst->id)];
+        if (def != UNDEFINED)
+            throw std::invalid_argument(fmt::format("malformed sequence {} redefines {} in {}", seq[def], *instr.dst, instr));
+        def = instr.id;
+    }
+    std::partial_sum(m_use_begin.begin(), m_use_begin.end(), m_use_begin.begin());
+    std::partial_sum(m_pred_begin.begin(), m_pred_begin.end(), m_pred_begin.begin());
+
+    m_uses.resize(m_use_begin.back());
+    m_preds.resize(m_pred_begin.back());
+    std::vector<uint32_t> next_use(m_use_begin.begin(), m_use_begin.end() - 1);
+    for (auto& instr : seq) {
+        auto pred = m_pred_begin[util::asInt(instr.id)];
         for (auto& op : instr.src) {
-            auto it = m_defined_by.find(op);
-            if (it == m_defined_by.end())
+            auto def = m_defined_by[util::asInt(op.id)];
+            if (def == UNDEFINED)
                 throw std::invalid_argument(fmt::format("malformed sequence {} is undefined in {}", op, instr));
-            m_used_by.emplace(op, instr);
+            m_preds[pred++] = def;
+            m_uses[next_use[util::asInt(op.id)]++] = instr.id;
         }
-        if (!instr.dst)
+    }
+    sortTopologically();
+}
+
+// depth first post order, which keeps an already sorted sequence intact
+void Dfg::sortTopologically() {
+    enum class Mark : uint8_t {
+        NONE,
+        ACTIVE,
+        DONE,
+    };
+    auto& seq = *m_sequence;
+    std::vector<Mark> marks(seq.size(), Mark::NONE);
+    std::vector<std::pair<Instruction::Id, uint32_t>> stack;
+    m_topological_order.reserve(seq.size());
+    for (auto& root : seq) {
+        if (marks[util::asInt(root.id)] != Mark::NONE)
             continue;
-        auto [prev, not_defined] = m_defined_by.emplace(*instr.dst, instr);
-        if (!not_defined)
-            throw std::invalid_argument(fmt::format("malformed sequence {} redefines {} in {}", prev->second, *instr.dst, instr));
+        marks[util::asInt(root.id)] = Mark::ACTIVE;
+        stack.emplace_back(root.id, 0);
+        while (!stack.empty()) {
+            auto [id, next] = stack.back();
+            auto preds = predecessors(seq[id]);
+            if (next < preds.size()) {
+                ++stack.back().second;
+                auto& mark = marks[util::asInt(preds[next])];
+                if (mark == Mark::ACTIVE)
+                    throw std::invalid_argument(fmt::format("malformed sequence {} depends on itself", seq[id]));
+                if (mark == Mark::NONE) {
+                    mark = Mark::ACTIVE;
+                    stack.emplace_back(preds[next], 0);
+                }
+                continue;
+            }
+            marks[util::asInt(id)] = Mark::DONE;
+            m_topological_order.push_back(id);
+            stack.pop_back();
+        }
     }
 }
 
-Dfg Dfg::fromSequence(const std::list<Instruction>& seq) {
+Dfg Dfg::fromSequence(const Sequence& seq) {
     return Dfg(seq);
 }
 
@@ -0,0 +1,333 @@
+#include <exprc/eval.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <variant>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <exprc/util.h>
+
+namespace exprc {
+
+namespace {
+
+uint64_t maskOf(uint32_t width) {
+    return width < 64 ? (uint64_t(1) << width) - 1 : ~uint64_t(0);
+}
+
+// a value of the batch takes this many bytes in every slot, i.e. several
+// SIMD registers, which hold 64 lanes of 8 bits each with AVX-512
+constexpr size_t BATCH_BYTES = 256;
+
+struct alignas(64) Slot {
+    unsigned char bytes[BATCH_BYTES];
+};
+
+// the body is inlined into every entry point below, so that it is compiled
+// for the instruction set of each with vectors as wide as its registers,
+// wider ones would be split into scalars for some operations
+template <typename Lane, size_t VECTOR_BYTES>
+[[gnu::always_inline]] inline void runBatches(const std::vector<Evaluator::Op>& ops, uint32_t slot_count, uint32_t input_count,
+                                              uint32_t output_count, util::Span<uint64_t> inputs, uint64_t* outputs) {
+    typedef Lane Vector __attribute__((vector_size(VECTOR_BYTES)));
+    constexpr size_t VECTORS = BATCH_BYTES / VECTOR_BYTES;
+    constexpr size_t LANES = BATCH_BYTES / sizeof(Lane);
+
+    std::vector<Slot> slots(slot_count);
+    auto vectors = [&](uint32_t slot) {
+        return reinterpret_cast<Vector*>(slots[slot].bytes);
+    };
+    auto lanes = [&](uint32_t slot) {
+        return reinterpret_cast<Lane*>(slots[slot].bytes);
+    };
+    auto count = inputs.size() / input_count;
+    for (size_t first = 0; first < count; first += LANES) {
+        auto size = std::min(LANES, count - first);
+        auto* in = inputs.begin() + first * input_count;
+        auto* out = outputs + first * output_count;
+        for (auto& op : ops) {
+            auto mask = static_cast<Lane>(op.mask);
+            auto value = static_cast<Lane>(op.value);
+            switch (op.opcode) {
+            case Opcode::INPUT: {
+                auto* lane = lanes(op.dst);
+                for (size_t i = 0; i < size; ++i)
+                    lane[i] = static_cast<Lane>(in[i * input_count + op.a] & op.mask);
+                break;
+            }
+            case Opcode::OUTPUT: {
+                auto* lane = lanes(op.a);
+                for (size_t i = 0; i < size; ++i)
+                    out[i * output_count + op.dst] = lane[i] & op.mask;
+                break;
+            }
+            case Opcode::CONST: {
+                auto* dst = vectors(op.dst);
+                for (size_t v = 0; v < VECTORS; ++v)
+                    dst[v] = Vector{} + value;
+                break;
+            }
+            case Opcode::ADD: {
+                auto* dst = vectors(op.dst);
+                auto* a = vectors(op.a);
+                auto* b = vectors(op.b);
+                for (size_t v = 0; v < VECTORS; ++v)
+                    dst[v] = (a[v] + b[v]) & mask;
+                break;
+            }
+            case Opcode::MUL: {
+                auto* dst = vectors(op.dst);
+                auto* a = vectors(op.a);
+                auto* b = vectors(op.b);
+                for (size_t v = 0; v < VECTORS; ++v)
+                    dst[v] = (a[v] * b[v]) & mask;
+                break;
+            }
+            case Opcode::MULC: {
+                auto* dst = vectors(op.dst);
+                auto* a = vectors(op.a);
+                for (size_t v = 0; v < VECTORS; ++v)
+                    dst[v] = (a[v] * value) & mask;
+                break;
+            }
+            }
+        }
+    }
+}
+
+template <typename Lane>
+void runGeneric(const std::vector<Evaluator::Op>& ops, uint32_t slots, uint32_t inputs, uint32_t outputs, util::Span<uint64_t> in,
+                uint64_t* out) {
+    runBatches<Lane, 16>(ops, slots, inputs, outputs, in, out);
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EXPRC_X86
+
+template <typename Lane>
+[[gnu::target("avx2")]] void runAvx2(const std::vector<Evaluator::Op>& ops, uint32_t slots, uint32_t inputs, uint32_t outputs,
+                                     util::Span<uint64_t> in, uint64_t* out) {
+    runBatches<Lane, 32>(ops, slots, inputs, outputs, in, out);
+}
+
+template <typename Lane>
+[[gnu::target("avx512f,avx512bw,avx512dq")]] void runAvx512(const std::vector<Evaluator::Op>& ops, uint32_t slots, uint32_t inputs,
+                                                           uint32_t outputs, util::Span<uint64_t> in, uint64_t* out) {
+    runBatches<Lane, 64>(ops, slots, inputs, outputs, in, out);
+}
+#endif
+
+enum class Isa {
+    GENERIC,
+    AVX2,
+    AVX512,
+};
+
+Isa hostIsa() {
+#ifdef EXPRC_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw") && __builtin_cpu_supports("avx512dq"))
+        return Isa::AVX512;
+    if (__builtin_cpu_supports("avx2"))
+        return Isa::AVX2;
+#endif
+    return Isa::GENERIC;
+}
+
+template <typename Lane>
+void runOnHost(const std::vector<Evaluator::Op>& ops, uint32_t slots, uint32_t inputs, uint32_t outputs, util::Span<uint64_t> in,
+               uint64_t* out) {
+    static const auto isa = hostIsa();
+#ifdef EXPRC_X86
+    if (isa == Isa::AVX512)
+        return runAvx512<Lane>(ops, slots, inputs, outputs, in, out);
+    if (isa == Isa::AVX2)
+        return runAvx2<Lane>(ops, slots, inputs, outputs, in, out);
+#endif
+    runGeneric<Lane>(ops, slots, inputs, outputs, in, out);
+}
+
+} // namespace
+
+Slots assignSlots(const Sequence& sequence) {
+    constexpr auto UNUSED = UINT32_MAX;
+    std::vector<uint32_t> last_use(sequence.operandCount(), UNUSED);
+    uint32_t index = 0;
+    for (auto& instr : sequence) {
+        for (auto& src : instr.src)
+            last_use[util::asInt(src.id)] = index;
+        ++index;
+    }
+
+    Slots slots;
+    slots.by_operand.resize(sequence.operandCount());
+    std::vector<uint32_t> free;
+    index = 0;
+    for (auto& instr : sequence) {
+        if (instr.dst) {
+            auto& slot = slots.by_operand[util::asInt(instr.dst->id)];
+            if (free.empty())
+                slot = slots.count++;
+            else {
+                slot = free.back();
+                free.pop_back();
+            }
+        }
+        for (size_t i = 0; i < instr.src.size(); ++i)
+            if (last_use[util::asInt(instr.src[i].id)] == index && (i == 0 || instr.src[1].id != instr.src[0].id))
+                free.push_back(slots.by_operand[util::asInt(instr.src[i].id)]);
+        // results nobody reads, as of unused inputs, are dropped at once
+        if (instr.dst && last_use[util::asInt(instr.dst->id)] == UNUSED)
+            free.push_back(slots.by_operand[util::asInt(instr.dst->id)]);
+        ++index;
+    }
+    return slots;
+}
+
+uint32_t laneWidth(const Sequence& sequence) {
+    uint32_t width = 1;
+    for (auto& instr : sequence)
+        width = std::max(width, instr.width);
+    return width <= 8 ? 8 : width <= 16 ? 16 : width <= 32 ? 32 : 64;
+}
+
+Evaluator::Evaluator(const Sequence& sequence)
+    : m_lane_width(exprc::laneWidth(sequence)) {
+    auto slots = assignSlots(sequence);
+    auto slot = [&](const Operand& op) {
+        return slots.by_operand[util::asInt(op.id)];
+    };
+    for (auto& instr : sequence) {
+        Op op{instr.opcode, 0, 0, 0, instr.value, maskOf(instr.width)};
+        if (instr.src.size() > 0)
+            op.a = op.b = slot(instr.src[0]);
+        if (instr.src.size() > 1)
+            op.b = slot(instr.src[1]);
+        if (instr.opcode == Opcode::OUTPUT)
+            op.dst = m_outputs++;
+        if (instr.opcode == Opcode::INPUT)
+            op.a = m_inputs++;
+        if (instr.dst)
+            op.dst = slot(*instr.dst);
+        m_ops.push_back(op);
+    }
+    // no slot at all leaves nothing to point at
+    m_slots = std::max(slots.count, 1u);
+}
+
+void Evaluator::run(util::Span<uint64_t> inputs, std::vector<uint64_t>& outputs) const {
+    if (!m_inputs || inputs.size() % m_inputs)
+        throw std::invalid_argument(fmt::format("expected vectors of {} inputs given {} values", m_inputs, inputs.size()));
+    outputs.resize(inputs.size() / m_inputs * m_outputs);
+    switch (m_lane_width) {
+    case 8:
+        return runOnHost<uint8_t>(m_ops, m_slots, m_inputs, m_outputs, inputs, outputs.data());
+    case 16:
+        return runOnHost<uint16_t>(m_ops, m_slots, m_inputs, m_outputs, inputs, outputs.data());
+    case 32:
+        return runOnHost<uint32_t>(m_ops, m_slots, m_inputs, m_outputs, inputs, outputs.data());
+    default:
+        return runOnHost<uint64_t>(m_ops, m_slots, m_inputs, m_outputs, inputs, outputs.data());
+    }
+}
+
+const char* Evaluator::isa() {
+    switch (hostIsa()) {
+    case Isa::AVX512:
+        return "avx512";
+    case Isa::AVX2:
+        return "avx2";
+    default:
+        return "generic";
+    }
+}
+
+ReferenceEvaluator::ReferenceEvaluator(const ast::Program& program, const Sequence& sequence, const NameTable& names,
+                                       const TranslateOptions& options)
+    : m_program(program)
+    , m_mask(options.full_precision ? ~uint64_t(0) : maskOf(options.width)) {
+    std::unordered_map<std::string_view, ast::NameId> ids;
+    for (uint32_t id = 0; id < program.names.size(); ++id)
+        ids.emplace(program.names[static_cast<ast::NameId>(id)], static_cast<ast::NameId>(id));
+    std::vector<uint32_t> widths(program.names.size(), options.width);
+    for (auto& assign : program.assigns)
+        if (auto* declare = std::get_if<ast::DeclareIn>(&assign))
+            widths[util::asInt(declare->name)] = declare->width;
+    for (auto& instr : sequence) {
+        if (instr.opcode == Opcode::INPUT) {
+            auto name = ids.at(names.inputs.at(instr.dst->id));
+            m_inputs.push_back(name);
+            m_input_masks.push_back(maskOf(widths[util::asInt(name)]));
+        }
+        if (instr.opcode == Opcode::OUTPUT)
+            m_outputs.push_back(ids.at(names.outputs.at(instr.id)));
+    }
+}
+
+// expressions are in post order, so every one is evaluated after its
+// operands going through them once
+void ReferenceEvaluator::run(util::Span<uint64_t> inputs, std::vector<uint64_t>& outputs) const {
+    if (m_inputs.empty() || inputs.size() % m_inputs.size())
+        throw std::invalid_argument(fmt::format("expected vectors of {} inputs given {} values", m_inputs.size(), inputs.size()));
+    auto count = inputs.size() / m_inputs.size();
+    outputs.resize(count * m_outputs.size());
+    std::vector<uint64_t> vars(m_program.names.size());
+    std::vector<uint64_t> exprs(m_program.exprs.size());
+    auto* in = inputs.begin();
+    auto* out = outputs.data();
+    for (size_t vector = 0; vector < count; ++vector) {
+        for (size_t i = 0; i < m_inputs.size(); ++i)
+            vars[util::asInt(m_inputs[i])] = *in++ & m_input_masks[i];
+        size_t next = 0;
+        auto evaluate = [&](ast::ExprId last) {
+            for (; next <= util::asInt(last); ++next)
+                exprs[next] = std::visit([&](auto& expr) -> uint64_t {
+                    using Expr = std::decay_t<decltype(expr)>;
+                    if constexpr (std::is_same_v<Expr, ast::Var>)
+                        return vars[util::asInt(expr.name)];
+                    else if constexpr (std::is_same_v<Expr, ast::Literal>)
+                        return expr.value;
+                    else if constexpr (std::is_same_v<Expr, ast::Add>)
+                        return exprs[util::asInt(expr.a)] + exprs[util::asInt(expr.b)];
+                    else
+                        return exprs[util::asInt(expr.a)] * exprs[util::asInt(expr.b)];
+                }, m_program.exprs[next]);
+            return exprs[util::asInt(last)] & m_mask;
+        };
+        for (auto& assign : m_program.assigns) {
+            if (auto* var = std::get_if<ast::AssignVar>(&assign))
+                vars[util::asInt(var->name)] = evaluate(var->expr);
+            else if (auto* output = std::get_if<ast::AssignOut>(&assign))
+                vars[util::asInt(output->name)] = evaluate(output->expr);
+        }
+        for (auto name : m_outputs)
+            *out++ = vars[util::asInt(name)];
+    }
+}
+
+// splitmix64, the same seed gives the same vectors everywhere
+std::vector<uint64_t> randomVectors(const Sequence& sequence, uint64_t vectors, uint64_t seed) {
+    std::vector<uint64_t> masks;
+    for (auto& instr : sequence)
+        if (instr.opcode == Opcode::INPUT)
+            masks.push_back(maskOf(instr.width));
+    std::vector<uint64_t> values;
+    values.reserve(vectors * masks.size());
+    for (uint64_t vector = 0; vector < vectors; ++vector)
+        for (auto mask : masks) {
+            seed += 0x9e3779b97f4a7c15ull;
+            auto z = seed;
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+            values.push_back((z ^ (z >> 31)) & mask);
+        }
+    return values;
+}
+
+} // namespace exprc
@@ -0,0 +1,126 @@
+#include <exprc/exprc.h>
+
+#include <ostream>
+#include <stdexcept>
+#include <streambuf>
+
+namespace exprc {
+
+namespace {
+
+// appends what is written into it to a string, so that output is not
+// copied once more out of a string stream
+class StringBuffer : public std::streambuf {
+public:
+    explicit StringBuffer(std::string& str)
+        : m_str(str) {
+    }
+
+protected:
+    int_type overflow(int_type c) override {
+        if (!traits_type::eq_int_type(c, traits_type::eof()))
+            m_str.push_back(traits_type::to_char_type(c));
+        return traits_type::not_eof(c);
+    }
+
+    std::streamsize xsputn(const char* s, std::streamsize n) override {
+        m_str.append(s, static_cast<size_t>(n));
+        return n;
+    }
+
+private:
+    std::string& m_str;
+};
+
+} // namespace
+
+void validate(const CompileOptions& options) {
+    auto& schedule = options.schedule;
+    if (schedule.force_directed && (schedule.max_adders || schedule.max_multipliers))
+        throw std::invalid_argument("force directed scheduling does not take --max-add / --max-mul");
+    if (schedule.force_directed && schedule.initiation_interval)
+        throw std::invalid_argument("force directed scheduling can not be pipelined");
+    if (schedule.force_directed && schedule.clock_period)
+        throw std::invalid_argument("force directed scheduling does not chain operations");
+    if (options.verilog.compact && options.verilog.case_muxes)
+        throw std::invalid_argument("--compact and --case-muxes are two layouts of the same muxes, choose one");
+    // C++ is written before scheduling, options of the design would do nothing
+    ScheduleOptions defaults;
+    auto& timing = schedule.timing;
+    if (options.emit == Emit::CPP &&
+        (schedule.max_adders || schedule.max_multipliers || schedule.force_directed || schedule.initiation_interval || schedule.clock_period ||
+         schedule.add_delay != defaults.add_delay || schedule.mul_delay != defaults.mul_delay || timing.mul_latency != defaults.timing.mul_latency ||
+         timing.pipelined_mul || !options.alloc.interconnect_aware || options.verilog.compact || options.verilog.case_muxes))
+        throw std::invalid_argument("--emit cpp is not scheduled and takes no options of the design or verilog");
+    if (options.cpp.harness && options.emit != Emit::CPP)
+        throw std::invalid_argument("--harness needs --emit cpp");
+}
+
+CompileResult compile(std::string_view source, const CompileOptions& options) {
+    validate(options);
+    CompileResult result;
+    stats::PassTimer timer;
+    Compilation compilation;
+    compilation.timer = &timer;
+    auto notify = [&](const char* pass) {
+        if (options.observer)
+            options.observer(pass, compilation);
+    };
+    auto finish = [&]() {
+        result.stats.passes = timer.passes();
+    };
+    StringBuffer buffer(result.output);
+    std::ostream os(&buffer);
+
+    timer.start("parse");
+    auto program = ast::parse(source);
+    timer.stop();
+    compilation.program = &program;
+    notify("parse");
+
+    timer.start("translate");
+    auto [sequence, names, reused] = translate(program, options.translate);
+    timer.stop();
+    compilation.sequence = &sequence;
+    compilation.names = &names;
+    compilation.reused = reused;
+    notify("translate");
+
+    if (options.emit == Emit::CPP) {
+        timer.start("dump");
+        cpp::dump(os, sequence, names, options.cpp);
+        timer.stop();
+        finish();
+        return result;
+    }
+
+    timer.start("dfg");
+    auto dfg = Dfg::fromSequence(sequence);
+    timer.stop();
+    compilation.dfg = &dfg;
+    notify("dfg");
+
+    timer.start("schedule");
+    auto sched = schedule(sequence, dfg, options.schedule);
+    timer.stop();
+    compilation.schedule = &sched;
+    notify("schedule");
+
+    timer.start("allocate");
+    auto data_path = allocate(sched, names, options.alloc);
+    timer.stop();
+    compilation.data_path = &data_path;
+    notify("allocate");
+
+    if (options.emit == Emit::VERILOG) {
+        timer.start("dump");
+        verilog::dump(os, data_path, options.verilog);
+        timer.stop();
+    }
+    if (options.stats)
+        result.stats.design = stats::design(sequence, sched, data_path);
+    finish();
+    return result;
+}
+
+} // namespace exprc
@@ -1,53 +1,377 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <fstream>
 #include <iostream>
-#include <list>
-#include <map>
-#include <unordered_map>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <sstream>
+#include <unordered_map>
+#include <vector>
 
 #include <fmt/format.h>
 
 #include <exprc/alloc.h>
+#include <exprc/batch.h>
+#include <exprc/cpp.h>
 #include <exprc/dev.h>
 #include <exprc/dfg.h>
+#include <exprc/eval.h>
+#include <exprc/exprc.h>
 #include <exprc/ir.h>
 #include <exprc/verilog.h>
 #include <exprc/parse.h>
 #include <exprc/schedule.h>
+#include <exprc/sim.h>
+#include <exprc/source.h>
+#include <exprc/stats.h>
 #include <exprc/translate.h>
 
 namespace {
 
+struct Options {
+    bool debug = false;
+    bool report = false;
+    const char* file = nullptr;
+    exprc::CompileOptions compile;
+    // file of input vectors to simulate
+    std::string vectors;
+    // random vectors to check the design on
+    uint64_t verify = 0;
+    // print time and allocations of every pass, statistics of the design
+    // into stderr, or write both into files
+    bool time_passes = false;
+    bool stats = false;
+    std::string stats_json;
+    std::string trace;
+    // directory or manifest of programs to compile on as many threads,
+    // writing outputs into the directory
+    std::string batch;
+    uint32_t jobs = 0;
+    std::string output_dir;
+};
+
 void usage() {
-    std::cout << "exprc [-d] prog.txt" << std::endl;
-    std::cout << "    -d  dump debug information" << std::endl;
+    std::cout << "exprc [-d] [--report] [--width N] [--full-precision] [--no-reassociate] [--max-add N] [--max-mul N] [--force-directed] [--latency N] [--pipeline II=N] [--clock-period NS [--add-delay NS] [--mul-delay NS]] [--mul-latency N [--pipelined-mul]] [--compact | --case-muxes] [--simulate vectors.txt] [--verify N] [--emit verilog|cpp [--harness]] [--time-passes] [--stats] [--stats-json FILE] [--trace FILE] prog.txt | --batch DIR|MANIFEST [-j N] [-o DIR]" << std::endl;
+    std::cout << "    -d                dump debug information" << std::endl;
+    std::cout << "    --report          print summary of the design into stderr" << std::endl;
+    std::cout << "    --width N         make inputs not declared otherwise and outputs N bits wide" << std::endl;
+    std::cout << "    --full-precision  widen values to keep every bit instead of wrapping around" << std::endl;
+    std::cout << "    --no-reassociate  keep chains of + and * in the order they are written" << std::endl;
+    std::cout << "    --max-add N       use at most N adders in a control step" << std::endl;
+    std::cout << "    --max-mul N       use at most N multipliers in a control step" << std::endl;
+    std::cout << "    --force-directed  balance usage of adders and multipliers over control steps" << std::endl;
+    std::cout << "    --latency N       take N control steps for force directed scheduling" << std::endl;
+    std::cout << "    --pipeline II=N   pipeline the data path to take new inputs every N cycles" << std::endl;
+    std::cout << "    --clock-period NS chain dependent operations within a control step of NS ns" << std::endl;
+    std::cout << "    --add-delay NS    take NS ns for an 8 bit addition, 1 by default" << std::endl;
+    std::cout << "    --mul-delay NS    take NS ns for an 8 bit multiplication, 3 by default" << std::endl;
+    std::cout << "    --mul-latency N   take N cycles for a multiplication" << std::endl;
+    std::cout << "    --pipelined-mul   make multipliers taking new operands every cycle" << std::endl;
+    std::cout << "    --compact         drive unused inputs of functional units X by default, not in every state" << std::endl;
+    std::cout << "    --case-muxes      give every input of a functional unit a case listing only its drivers" << std::endl;
+    std::cout << "    --simulate FILE   run the design on input vectors of FILE instead of writing verilog" << std::endl;
+    std::cout << "    --verify N        check the design against the program on N random input vectors" << std::endl;
+    std::cout << "    --emit cpp        write a C++ function computing the program over arrays instead of verilog" << std::endl;
+    std::cout << "    --harness         add main() measuring elements per second of the C++ function" << std::endl;
+    std::cout << "    --time-passes     print time, allocations and peak memory of every pass into stderr" << std::endl;
+    std::cout << "    --stats           print numbers of instructions, steps, functional units, registers and mux inputs into stderr" << std::endl;
+    std::cout << "    --stats-json FILE write both of them into FILE as JSON" << std::endl;
+    std::cout << "    --trace FILE      write passes into FILE as a Chrome trace" << std::endl;
+    std::cout << "    --batch DIR       compile every .txt file of DIR, or every file listed by MANIFEST a line" << std::endl;
+    std::cout << "    -j N              compile N programs at once, as many as the host runs by default" << std::endl;
+    std::cout << "    -o DIR            write outputs of --batch into DIR instead of next to programs" << std::endl;
+    std::cout << "    use '-' as prog.txt to read program from stdin" << std::endl;
+}
+
+uint32_t toCount(const std::string& arg) {
+    if (arg.empty() || arg.find_first_not_of("0123456789") != std::string::npos)
+        throw std::invalid_argument(fmt::format("expected positive number given '{}'", arg));
+    // stoull does not overflow on ten digits, leading zeros aside
+    auto digits = arg.size() - std::min(arg.find_first_not_of('0'), arg.size());
+    auto value = digits > 10 ? UINT64_MAX : std::stoull(arg);
+    if (!value)
+        throw std::invalid_argument(fmt::format("expected positive number given '{}'", arg));
+    if (value > UINT32_MAX)
+        throw std::invalid_argument(fmt::format("number '{}' is out of range [1, {}]", arg, UINT32_MAX));
+    return static_cast<uint32_t>(value);
+}
+
+double toTime(const std::string& arg) {
+    size_t end = 0;
+    double time = 0;
+    try {
+        time = std::stod(arg, &end);
+    }
+    catch (const std::logic_error&) {
+    }
+    if (end != arg.size() || !(time > 0) || time > 1e9)
+        throw std::invalid_argument(fmt::format("expected positive time in ns given '{}'", arg));
+    return time;
+}
+
+Options parseArgs(int argc, char* argv[]) {
+    Options options;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto value = [&]() {
+            if (i + 1 == argc)
+                throw std::invalid_argument(fmt::format("{} expects a value", arg));
+            return std::string(argv[++i]);
+        };
+        if (arg == "-d")
+            options.debug = true;
+        else if (arg == "--report")
+            options.report = true;
+        else if (arg == "--width")
+            options.compile.translate.width = toCount(value());
+        else if (arg == "--full-precision")
+            options.compile.translate.full_precision = true;
+        else if (arg == "--no-reassociate")
+            options.compile.translate.reassociate = false;
+        else if (arg == "--max-add")
+            options.compile.schedule.max_adders = toCount(value());
+        else if (arg == "--max-mul")
+            options.compile.schedule.max_multipliers = toCount(value());
+        else if (arg == "--force-directed")
+            options.compile.schedule.force_directed = true;
+        else if (arg == "--latency") {
+            options.compile.schedule.force_directed = true;
+            options.compile.schedule.latency = toCount(value());
+        }
+        else if (arg == "--pipeline") {
+            auto ii = value();
+            options.compile.schedule.initiation_interval = toCount(ii.compare(0, 3, "II=") == 0 ? ii.substr(3) : ii);
+        }
+        else if (arg == "--clock-period")
+            options.compile.schedule.clock_period = toTime(value());
+        else if (arg == "--add-delay")
+            options.compile.schedule.add_delay = toTime(value());
+        else if (arg == "--mul-delay")
+            options.compile.schedule.mul_delay = toTime(value());
+        else if (arg == "--mul-latency")
+            options.compile.schedule.timing.mul_latency = toCount(value());
+        else if (arg == "--pipelined-mul")
+            options.compile.schedule.timing.pipelined_mul = true;
+        else if (arg == "--compact")
+            options.compile.verilog.compact = true;
+        else if (arg == "--case-muxes")
+            options.compile.verilog.case_muxes = true;
+        else if (arg == "--simulate")
+            options.vectors = value();
+        else if (arg == "--verify")
+            options.verify = toCount(value());
+        else if (arg == "--emit") {
+            auto emit = value();
+            if (emit != "verilog" && emit != "cpp")
+                throw std::invalid_argument(fmt::format("expected verilog or cpp to emit given '{}'", emit));
+            options.compile.emit = emit == "cpp" ? exprc::Emit::CPP : exprc::Emit::VERILOG;
+        }
+        else if (arg == "--harness")
+            options.compile.cpp.harness = true;
+        else if (arg == "--time-passes")
+            options.time_passes = true;
+        else if (arg == "--stats")
+            options.stats = true;
+        else if (arg == "--stats-json")
+            options.stats_json = value();
+        else if (arg == "--trace")
+            options.trace = value();
+        else if (arg == "--batch")
+            options.batch = value();
+        else if (arg == "-j")
+            options.jobs = toCount(value());
+        else if (arg == "-o")
+            options.output_dir = value();
+        else if (!options.file && (arg == "-" || arg[0] != '-'))
+            options.file = argv[i];
+        else
+            throw std::invalid_argument(fmt::format("unexpected argument '{}'", arg));
+    }
+    if (!options.batch.empty()) {
+        if (options.file)
+            throw std::invalid_argument("--batch takes programs of its own");
+        if (options.debug || options.report || !options.vectors.empty() || options.verify || options.time_passes || options.stats ||
+            !options.stats_json.empty() || !options.trace.empty())
+            throw std::invalid_argument("--batch only writes outputs, but does not debug, report, verify, simulate or time them");
+    }
+    else if (options.jobs || !options.output_dir.empty())
+        throw std::invalid_argument("-j and -o go with --batch");
+    else if (!options.file)
+        throw std::invalid_argument("no program given");
+    exprc::validate(options.compile);
+    if (options.compile.emit == exprc::Emit::CPP && (!options.vectors.empty() || options.verify))
+        throw std::invalid_argument("C++ is not simulated or verified, run it instead");
+    // simulation takes the place of verilog
+    if (!options.vectors.empty())
+        options.compile.emit = exprc::Emit::NONE;
+    options.compile.stats = options.stats || !options.stats_json.empty();
+    return options;
 }
 
-void checkForDeadCode(const std::list<exprc::Instruction>& sequence, const exprc::Dfg& dfg, const std::unordered_map<exprc::Operand::Id, const std::string>& name_table) {
-    auto empty = [](const auto& range) {
-        return range.first == range.second;
+void reportSchedule(const exprc::Schedule& sched, const exprc::Sequence& sequence, const exprc::Dfg& dfg) {
+    // ASAP schedule to compare with runs the same functional units
+    exprc::ScheduleOptions asap_options;
+    asap_options.timing = sched.timing();
+    auto summary = [](const exprc::Schedule& sched) {
+        auto ii = sched.initiationInterval() ? fmt::format("II {}, ", sched.initiationInterval()) : std::string();
+        return fmt::format("{}latency {}, {} adders, {} multipliers", ii, sched.latency(), sched.peakUsage(exprc::Opcode::ADD), sched.peakUsage(exprc::Opcode::MUL));
     };
-    for (auto& instr : sequence) {
-        if (!instr.dst)
-            continue;
-        auto& dst = *instr.dst;
-        if (empty(dfg.usedBy(dst)))
-            throw std::invalid_argument(fmt::format("variable {} is not used neither in 'out' statement nor in another expression", name_table.at(dst)));
+    std::cerr << "schedule: " << summary(sched);
+    uint32_t chained = 0;
+    // only operations may take results of others computed in the same step
+    for (auto& instr : sequence)
+        for (auto pred : dfg.predecessors(instr))
+            if (sched.stepOf(sequence[pred]) == sched.stepOf(instr)) {
+                ++chained;
+                break;
+            }
+    if (chained)
+        std::cerr << ", " << chained << " operations chained";
+    auto asap = schedule(sequence, dfg, asap_options);
+    std::cerr << " (asap: " << summary(asap) << ")" << std::endl;
+}
+
+void reportDataPath(const exprc::DataPath& data_path, const exprc::Schedule& sched, const exprc::NameTable& names) {
+    uint32_t bits = 0;
+    for (auto& [id, reg] : data_path.registers)
+        bits += reg.width;
+    std::cerr << "data path: " << data_path.registers.size() << " registers (" << bits << " bits), " << data_path.const_multipliers.size()
+              << " constant multipliers, " << exprc::countMuxInputs(data_path) << " mux inputs";
+    // pipelined data path has only one binding
+    if (!sched.initiationInterval()) {
+        auto naive = exprc::allocate(sched, names, {false});
+        std::cerr << " (naive binding: " << exprc::countMuxInputs(naive) << " mux inputs)";
     }
+    std::cerr << std::endl;
 }
 
-void doAll(bool debug, const char* file) {
-    std::ifstream stream(file);
-    auto [sequence, name_table] = exprc::translate(exprc::ast::parse(stream));
+// outputs of every vector go into stdout a line, the summary into stderr
+void simulate(const exprc::DataPath& data_path, const std::string& file) {
+    exprc::sim::Simulator simulator(data_path);
+    auto source = exprc::Source::fromFile(file);
+    auto inputs = exprc::sim::parseVectors(source.text(), simulator.inputCount());
+    std::vector<uint64_t> outputs;
+    auto start = std::chrono::steady_clock::now();
+    auto stats = simulator.run({inputs.data(), inputs.data() + inputs.size()}, outputs);
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
 
-    if (debug) {
-        for (auto& instr : sequence)
-            std::cout << instr << std::endl;
-        std::cout << std::endl;
+    fmt::memory_buffer buf;
+    auto* values = outputs.data();
+    for (uint64_t vector = 0; vector < stats.vectors; ++vector)
+        for (size_t i = 0; i < simulator.outputCount(); ++i)
+            fmt::format_to(std::back_inserter(buf), "{}{}", *values++, i + 1 < simulator.outputCount() ? ' ' : '\n');
+    std::cout.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+
+    std::cerr << fmt::format("simulation: {} vectors, {} cycles, latency {}, interval {}, {:.3f} s ({:.2f}M vectors/s)",
+                             stats.vectors, stats.cycles, stats.latency, stats.interval, seconds.count(),
+                             seconds.count() > 0 ? stats.vectors / seconds.count() / 1e6 : 0.0) << std::endl;
+    for (auto& [name, busy] : stats.busy)
+        std::cerr << fmt::format("  {}: {} busy cycles ({:.1f}%)", name, busy, stats.cycles ? 100.0 * busy / stats.cycles : 0.0) << std::endl;
+}
+
+// the sequence is checked against the program as written and the data path
+// against the sequence, on the same random vectors a chunk at a time
+void verify(uint64_t vectors, const exprc::ast::Program& program, const exprc::Sequence& sequence, const exprc::NameTable& names,
+            const exprc::TranslateOptions& translate, const exprc::DataPath& data_path) {
+    using Clock = std::chrono::steady_clock;
+    exprc::Evaluator evaluator(sequence);
+    exprc::ReferenceEvaluator reference(program, sequence, names, translate);
+    exprc::sim::Simulator simulator(data_path);
+    if (!evaluator.inputCount())
+        throw std::invalid_argument("program takes no inputs to verify with");
+
+    std::vector<std::string> input_names;
+    std::vector<std::string> output_names;
+    for (auto& instr : sequence) {
+        if (instr.opcode == exprc::Opcode::INPUT)
+            input_names.push_back(names.inputs.at(instr.dst->id));
+        if (instr.opcode == exprc::Opcode::OUTPUT)
+            output_names.push_back(names.outputs.at(instr.id));
+    }
+    // ports of the data path by their index in the sequence
+    auto indices = [](const std::vector<std::string>& names, auto& ports) {
+        std::unordered_map<std::string, size_t> index;
+        for (size_t i = 0; i < names.size(); ++i)
+            index.emplace(names[i], i);
+        std::vector<size_t> indices;
+        for (auto& port : ports)
+            indices.push_back(index.at(port.name));
+        return indices;
+    };
+    auto sim_inputs = indices(input_names, data_path.inputs);
+    auto sim_outputs = indices(output_names, data_path.outputs);
+
+    auto mismatch = [&](const char* what, const uint64_t* in, size_t output, uint64_t got, uint64_t expected) {
+        std::string given;
+        for (size_t i = 0; i < input_names.size(); ++i)
+            given += fmt::format("{}{} = {}", i ? ", " : "", input_names[i], in[i]);
+        return std::invalid_argument(fmt::format("{} gives {} = {} instead of {} for {}", what, output_names[output], got, expected, given));
+    };
+
+    constexpr uint64_t CHUNK = 1 << 16;
+    std::chrono::duration<double> sequence_time{}, program_time{}, data_path_time{};
+    std::vector<uint64_t> expected, got, permuted, simulated;
+    for (uint64_t first = 0; first < vectors; first += CHUNK) {
+        auto count = std::min(CHUNK, vectors - first);
+        auto inputs = exprc::randomVectors(sequence, count, first);
+        exprc::util::Span<uint64_t> span(inputs.data(), inputs.data() + inputs.size());
+        auto start = Clock::now();
+        reference.run(span, expected);
+        auto evaluated = Clock::now();
+        evaluator.run(span, got);
+        auto simulating = Clock::now();
+        permuted.resize(inputs.size());
+        for (uint64_t vector = 0; vector < count; ++vector)
+            for (size_t i = 0; i < sim_inputs.size(); ++i)
+                permuted[vector * sim_inputs.size() + i] = inputs[vector * sim_inputs.size() + sim_inputs[i]];
+        simulator.run({permuted.data(), permuted.data() + permuted.size()}, simulated);
+        data_path_time += Clock::now() - simulating;
+        sequence_time += simulating - evaluated;
+        program_time += evaluated - start;
+
+        auto outputs = output_names.size();
+        for (uint64_t vector = 0; vector < count; ++vector) {
+            auto* in = inputs.data() + vector * input_names.size();
+            for (size_t i = 0; i < outputs; ++i)
+                if (got[vector * outputs + i] != expected[vector * outputs + i])
+                    throw mismatch("translation", in, i, got[vector * outputs + i], expected[vector * outputs + i]);
+            for (size_t i = 0; i < outputs; ++i) {
+                auto output = sim_outputs[i];
+                if (simulated[vector * outputs + i] != got[vector * outputs + output])
+                    throw mismatch("data path", in, output, simulated[vector * outputs + i], got[vector * outputs + output]);
+            }
+        }
     }
+    auto rate = [&](std::chrono::duration<double> time) {
+        return fmt::format("{:.3f} s, {:.2f}M vectors/s", time.count(), time.count() > 0 ? vectors / time.count() / 1e6 : 0.0);
+    };
+    std::cerr << fmt::format("verify: {} vectors match, program {}, sequence {} ({}-bit lanes, {}), data path {}", vectors, rate(program_time),
+                             rate(sequence_time), evaluator.laneWidth(), exprc::Evaluator::isa(), rate(data_path_time)) << std::endl;
+}
 
-    auto dfg = exprc::Dfg::fromSequence(sequence);
-    if (debug) {
+// prints what options ask for about results of every pass as soon as it
+// is done, checks and simulates the data path once it is made
+void observe(const Options& options, const char* pass, const exprc::Compilation& compilation) {
+    // nothing to tell about the program as parsed
+    if (!compilation.sequence)
+        return;
+    auto debug = options.debug;
+    auto& sequence = *compilation.sequence;
+    std::string_view name = pass;
+    if (name == "translate") {
+        if (options.report)
+            std::cerr << "translate: " << sequence.size() << " instructions, " << compilation.reused << " removed by value numbering" << std::endl;
+        if (debug) {
+            for (auto& instr : sequence)
+                std::cout << instr << std::endl;
+            std::cout << std::endl;
+        }
+    }
+    else if (name == "dfg" && debug) {
+        auto& dfg = *compilation.dfg;
         for (auto& instr : sequence) {
             std::cout << instr << " depends on: " << std::endl;
             for (auto& op : instr.src)
@@ -58,47 +382,122 @@ void doAll(bool debug, const char* file) {
             std::cout << instr << " used by: " << std::endl;
             if (!instr.dst)
                 continue;
-            for (auto p : dfg.usedBy(*instr.dst)) {
-                std::cout << "  " << p.second.get() << std::endl;
-            }
+            for (auto user : dfg.usedBy(*instr.dst))
+                std::cout << "  " << sequence[user] << std::endl;
         }
         std::cout << std::endl;
     }
+    else if (name == "schedule") {
+        auto& sched = *compilation.schedule;
+        if (options.report)
+            reportSchedule(sched, sequence, *compilation.dfg);
+        if (debug) {
+            for (uint32_t step = 0; step <= sched.lastStep(); ++step)
+                for (auto id : sched.at(step))
+                    std::cout << step << ": " << sequence[id] << std::endl;
+            std::cout << std::endl;
+        }
+    }
+    else if (name == "allocate") {
+        auto& data_path = *compilation.data_path;
+        auto& timer = *compilation.timer;
+        if (options.report)
+            reportDataPath(data_path, *compilation.schedule, *compilation.names);
+        if (options.verify) {
+            timer.start("verify");
+            verify(options.verify, *compilation.program, sequence, *compilation.names, options.compile.translate, data_path);
+            timer.stop();
+        }
+        if (!options.vectors.empty()) {
+            timer.start("simulate");
+            simulate(data_path, options.vectors);
+            timer.stop();
+        }
+    }
+}
 
-    checkForDeadCode(sequence, dfg, name_table);
+// the report goes wherever options ask for it once every pass is done
+void report(const Options& options, const exprc::stats::Report& report) {
+    if (options.time_passes)
+        exprc::stats::printPasses(std::cerr, report);
+    if (options.stats && report.design)
+        exprc::stats::printDesign(std::cerr, *report.design);
+    auto write = [&](const std::string& file, auto print) {
+        if (file.empty())
+            return;
+        std::ofstream os(file);
+        print(os, report);
+        if (!os.flush())
+            throw std::invalid_argument(fmt::format("can not write {}", file));
+    };
+    write(options.stats_json, exprc::stats::writeJson);
+    write(options.trace, exprc::stats::writeTrace);
+}
 
-    auto sched = schedule(sequence, dfg);
-    if (debug) {
-        for (auto& [step, instr] : sched)
-            std::cout << step << ": " << instr << std::endl;
-        std::cout << std::endl;
+void doAll(const Options& options) {
+    auto* file = options.file;
+    exprc::stats::PassTimer timer;
+    timer.start("read");
+    auto source = (file == std::string("-")) ? exprc::Source::fromStream(std::cin) : exprc::Source::fromFile(file);
+    timer.stop();
+    auto compile = options.compile;
+    compile.observer = [&](const char* pass, const exprc::Compilation& compilation) {
+        observe(options, pass, compilation);
+    };
+    auto result = exprc::compile(source.text(), compile);
+    std::cout.write(result.output.data(), static_cast<std::streamsize>(result.output.size()));
+    std::cout.flush();
+    // passes of compile() start right after reading
+    auto passes = timer.passes();
+    auto read = passes.back().start + passes.back().wall;
+    for (auto pass : result.stats.passes) {
+        pass.start += read;
+        passes.push_back(pass);
     }
+    result.stats.passes = std::move(passes);
+    result.stats.peak_rss = exprc::stats::peakRss();
+    report(options, result.stats);
+}
+
+// errors of programs go into stderr with a summary, but stop none of them
+int doBatch(const Options& options) {
+    auto start = std::chrono::steady_clock::now();
+    auto extension = options.compile.emit == exprc::Emit::CPP ? ".cpp" : ".v";
+    auto jobs = exprc::batch::jobs(options.batch, options.output_dir, extension);
+    auto threads = options.jobs ? options.jobs : std::max(1u, std::thread::hardware_concurrency());
+    auto results = exprc::batch::run(jobs, options.compile, threads);
+    std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
 
-    auto data_path = exprc::allocate(sched, name_table);
-    exprc::verilog::dump(std::cout, data_path);
+    size_t failed = 0;
+    for (size_t i = 0; i < jobs.size(); ++i) {
+        if (results[i].error.empty())
+            continue;
+        std::cerr << "Error: " << jobs[i].input << ": " << results[i].error << std::endl;
+        ++failed;
+    }
+    std::cerr << fmt::format("batch: {} programs, {} failed, {} threads, {:.3f} s ({:.1f} programs/s)", jobs.size(), failed,
+                             std::min<size_t>(threads, jobs.size()), seconds.count(),
+                             seconds.count() > 0 ? jobs.size() / seconds.count() : 0.0) << std::endl;
+    return failed ? 1 : 0;
 }
 
 } // namespace
 
 int main(int argc, char* argv[]) {
-    if (argc < 2 || argc > 3) {
+    Options options;
+    try {
+        options = parseArgs(argc, argv);
+    }
+    catch (const std::invalid_argument& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
         usage();
         return 1;
     }
 
-    bool debug = false;
-    auto* file = argv[1];
-    if (argc == 3) {
-        if (argv[1] != std::string("-d")) {
-            usage();
-            return 1;
-        }
-        debug = true;
-        file = argv[2];
-    }
-
     try {
-        doAll(debug, file);
+        if (!options.batch.empty())
+            return doBatch(options);
+        doAll(options);
     }
     catch (const std::invalid_argument& e) {
         std::cerr << "Error: " << e.what() << std::endl;
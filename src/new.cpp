@@ -0,0 +1,94 @@
+#include <cstdlib>
+#include <new>
+
+#include <exprc/stats.h>
+
+// global allocation functions counting allocations of the calling thread
+// for --time-passes, memory comes from malloc as with the default ones
+
+namespace {
+
+void* allocate(std::size_t size) {
+    exprc::stats::countAllocation(size);
+    if (auto* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* allocate(std::size_t size, std::align_val_t align) {
+    exprc::stats::countAllocation(size);
+    auto alignment = static_cast<std::size_t>(align);
+    // aligned_alloc takes sizes of whole alignments only
+    auto rounded = size ? (size + alignment - 1) / alignment * alignment : alignment;
+    if (auto* ptr = std::aligned_alloc(alignment, rounded))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+} // namespace
+
+void* operator new(std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new[](std::size_t size) {
+    return allocate(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    }
+    catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    try {
+        return allocate(size);
+    }
+    catch (const std::bad_alloc&) {
+        return nullptr;
+    }
+}
+
+void* operator new(std::size_t size, std::align_val_t align) {
+    return allocate(size, align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align) {
+    return allocate(size, align);
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t) noexcept {
+    std::free(ptr);
+}
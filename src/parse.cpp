@@ -1,39 +1,31 @@
 #include <exprc/parse.h>
 
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <functional>
 #include <istream>
 #include <variant>
 #include <string>
-#include <memory>
-#include <regex>
+#include <string_view>
+#include <utility>
 
 #include <fmt/format.h>
 #include <fmt/ostream.h>
 
+#include <exprc/ir.h>
+#include <exprc/source.h>
+
 namespace exprc {
 
 namespace ast {
 
 namespace {
 
-auto add(std::unique_ptr<Expr> a, std::unique_ptr<Expr> b) {
-    return std::make_unique<Expr>(Add{std::move(a), std::move(b)});
-}
-
-auto mul(std::unique_ptr<Expr> a, std::unique_ptr<Expr> b) {
-    return std::make_unique<Expr>(Mul{std::move(a), std::move(b)});
-}
-
-auto var(std::string name) {
-    return std::make_unique<Expr>(Var{std::move(name)});
-}
-
-template <typename Type>
-auto assign(std::string name, std::unique_ptr<Expr> e) {
-    return Type{std::move(name), std::move(e)};
-}
-
 enum class Tok {
     VAR = 'v',
+    NUM = 'n',
+    IN = 'i',
     OUT = 'o',
     ADD = '+',
     MUL = '*',
@@ -42,96 +34,167 @@ enum class Tok {
     LPAREN = '(',
     RPAREN = ')',
     ASSIGN = '=',
+    COLON = ':',
 };
 
 struct Token {
-    operator Tok() {
+    operator Tok() const {
         return tok;
     }
 
     Tok tok;
-    std::string value;
+    std::string_view value;
+    uint32_t line;
+    uint32_t col;
 };
 
 std::ostream& operator<<(std::ostream& os, const Token& token) {
     if (token.tok == Tok::VAR)
-        return os << "<VAR<" << token.value << ">>";
-    if (token.tok == Tok::OUT)
-        return os << "<OUT>";
-    return os << static_cast<char>(token.tok);
+        os << "<VAR<" << token.value << ">>";
+    else if (token.tok == Tok::NUM)
+        os << "<NUM<" << token.value << ">>";
+    else if (token.tok == Tok::IN)
+        os << "<IN>";
+    else if (token.tok == Tok::OUT)
+        os << "<OUT>";
+    else if (token.tok == Tok::END)
+        os << "<END>";
+    else
+        os << static_cast<char>(token.tok);
+    return os << " at " << token.line << ":" << token.col;
+}
+
+enum CharClass : uint8_t {
+    OTHER = 0,
+    SPACE = 1 << 0,
+    WORD = 1 << 1,
+    SYMBOL = 1 << 2,
+    DIGIT = 1 << 3,
+};
+
+constexpr std::array<uint8_t, 256> makeCharClasses() {
+    std::array<uint8_t, 256> classes{};
+    for (unsigned char c : {' ', '\t', '\n', '\v', '\f', '\r'})
+        classes[c] = SPACE;
+    for (unsigned c = 'a'; c <= 'z'; ++c)
+        classes[c] = WORD;
+    for (unsigned c = 'A'; c <= 'Z'; ++c)
+        classes[c] = WORD;
+    for (unsigned c = '0'; c <= '9'; ++c)
+        classes[c] = WORD | DIGIT;
+    classes['_'] = WORD;
+    for (unsigned char c : {'(', ')', '+', '*', '=', ';', ':'})
+        classes[c] = SYMBOL;
+    return classes;
+}
+
+constexpr auto char_classes = makeCharClasses();
+
+inline bool is(char c, CharClass cls) {
+    return char_classes[static_cast<unsigned char>(c)] & cls;
 }
 
+// scans the whole program kept in memory, VAR tokens are views into it
 class Tokenizer {
 public:
-    Tokenizer(std::istream& is)
-        : m_is(is)
-        , m_iter(m_buf.cend())
-        , m_eof(false) {
-    }
-
-    auto next() {
-        if (m_eof)
-            return Token{Tok::END};
-        std::smatch match;
-        while (true) {
-            if (m_iter == m_buf.end()) {
-                m_eof = !std::getline(m_is, m_buf);
-                if (m_eof)
-                    return Token{Tok::END};
-                m_iter = m_buf.begin();
+    Tokenizer(std::string_view text)
+        : m_cur(text.data())
+        , m_end(text.data() + text.size())
+        , m_line_begin(m_cur) {
+    }
+
+    Token next() {
+        skipSpace();
+        if (m_cur == m_end)
+            return make(Tok::END, m_cur);
+        auto* begin = m_cur;
+        if (is(*m_cur, WORD)) {
+            while (m_cur != m_end && is(*m_cur, WORD))
+                ++m_cur;
+            std::string_view word(begin, m_cur - begin);
+            if (is(*begin, DIGIT)) {
+                if (!std::all_of(word.begin(), word.end(), [](char c) { return is(c, DIGIT); }))
+                    throw std::invalid_argument(fmt::format("invalid number '{}' at {}:{}", word, m_line, column(begin)));
+                return make(Tok::NUM, begin, word);
             }
-            if (!std::regex_search(m_iter, m_buf.cend(), match, m_space))
-                break;
-            m_iter = match[0].second;
-        }
-        if (std::regex_search(m_iter, m_buf.cend(), match, m_out)) {
-            m_iter = match[0].second;
-            return Token{Tok::OUT};
-        }
-        if (std::regex_search(m_iter, m_buf.cend(), match, m_variable)) {
-            m_iter = match[0].second;
-            return Token{Tok::VAR, std::string(match[0].first, match[0].second)};
-        }
-        if (std::regex_search(m_iter, m_buf.cend(), match, m_symbol)) {
-            m_iter = match[0].second;
-            return Token{static_cast<Tok>(*match[0].first)};
+            // 'out' is a keyword when separated from the following variable,
+            // 'in' only when a declaration follows, so that variables named
+            // 'in' stay valid
+            if (word == "in" && declarationFollows())
+                return make(Tok::IN, begin);
+            if (word == "out" && m_cur != m_end && is(*m_cur, SPACE))
+                return make(Tok::OUT, begin);
+            return make(Tok::VAR, begin, word);
         }
-        throw std::invalid_argument(fmt::format("unexpected symbol {}", *m_iter));
+        if (is(*m_cur, SYMBOL))
+            return make(static_cast<Tok>(*m_cur++), begin);
+        throw std::invalid_argument(fmt::format("unexpected symbol '{}' at {}:{}", *m_cur, m_line, column(m_cur)));
     }
 
 private:
-    std::istream& m_is;
-    std::string m_buf;
-    std::string::const_iterator m_iter;
-    bool m_eof;
-    const std::regex m_space{R"(^\s+)"};
-    const std::regex m_out{R"(^out\s+)"};
-    const std::regex m_variable{R"(^[a-zA-Z0-9_]+)"};
-    const std::regex m_symbol{R"(^[()+*=;])"};
+    // whitespace, a variable, whitespace and ':' are next
+    bool declarationFollows() const {
+        auto* cur = m_cur;
+        if (cur == m_end || !is(*cur, SPACE))
+            return false;
+        while (cur != m_end && is(*cur, SPACE))
+            ++cur;
+        if (cur == m_end || !is(*cur, WORD) || is(*cur, DIGIT))
+            return false;
+        while (cur != m_end && is(*cur, WORD))
+            ++cur;
+        while (cur != m_end && is(*cur, SPACE))
+            ++cur;
+        return cur != m_end && *cur == ':';
+    }
+
+    void skipSpace() {
+        for (; m_cur != m_end && is(*m_cur, SPACE); ++m_cur)
+            if (*m_cur == '\n') {
+                ++m_line;
+                m_line_begin = m_cur + 1;
+            }
+    }
+
+    uint32_t column(const char* pos) const {
+        return static_cast<uint32_t>(pos - m_line_begin) + 1;
+    }
+
+    Token make(Tok tok, const char* begin, std::string_view value = {}) const {
+        return Token{tok, value, m_line, column(begin)};
+    }
+
+    const char* m_cur;
+    const char* const m_end;
+    const char* m_line_begin;
+    uint32_t m_line = 1;
 };
 
 class Parser {
 public:
-    Parser(std::istream& is)
-        : m_tokenizer(is) {
+    Parser(std::string_view text)
+        : m_tokenizer(text) {
     }
 
-    // P -> { A ';' | 'out' A ';' }*
-    std::list<Assign> parse() {
-        std::list<Assign> program;
+    // P -> { A ';' | 'out' A ';' | 'in' D ';' }*
+    Program parse() {
         next();
         while (m_tok != Tok::END) {
-            if (m_tok == Tok::OUT) {
+            if (m_tok == Tok::IN) {
+                next();
+                m_program.assigns.emplace_back(parseDeclaration());
+            }
+            else if (m_tok == Tok::OUT) {
                 next();
-                program.emplace_back(parseAssign<AssignOut>());
+                m_program.assigns.emplace_back(parseAssign<AssignOut>());
             }
             else
-                program.emplace_back(parseAssign<AssignVar>());
+                m_program.assigns.emplace_back(parseAssign<AssignVar>());
             if (m_tok != Tok::SEM)
                 throw std::invalid_argument(fmt::format("unexpected trailing symbol {}", m_tok));
             next();
         }
-        return program;
+        return std::move(m_program);
     }
 
 private:
@@ -139,43 +202,74 @@ private:
         m_tok = m_tokenizer.next();
     }
 
+    ExprId make(Expr expr) {
+        auto id = static_cast<ExprId>(m_program.exprs.size());
+        m_program.exprs.push_back(expr);
+        return id;
+    }
+
     // A -> V = E
     template <typename Type>
     Assign parseAssign() {
         if (m_tok != Tok::VAR)
             throw std::invalid_argument(fmt::format("expected varname given {}", m_tok));
-        auto name = m_tok.value;
+        auto name = m_program.names.intern(m_tok.value);
         next();
         if (m_tok != Tok::ASSIGN)
             throw std::invalid_argument(fmt::format("expected assignment given {}", m_tok));
         next();
-        return Type{std::move(name), parseExpr()};
+        return Type{name, parseExpr()};
+    }
+
+    // D -> V ':' N
+    Assign parseDeclaration() {
+        if (m_tok != Tok::VAR)
+            throw std::invalid_argument(fmt::format("expected varname given {}", m_tok));
+        auto name = m_program.names.intern(m_tok.value);
+        next();
+        if (m_tok != Tok::COLON)
+            throw std::invalid_argument(fmt::format("expected ':' given {}", m_tok));
+        next();
+        if (m_tok != Tok::NUM)
+            throw std::invalid_argument(fmt::format("expected width given {}", m_tok));
+        auto width = parseNumber();
+        if (width < 1 || width > MAX_WIDTH)
+            throw std::invalid_argument(fmt::format("width {} is out of range [1, {}]", m_tok, MAX_WIDTH));
+        next();
+        return DeclareIn{name, static_cast<uint32_t>(width)};
     }
 
     // E -> T { '+' }*
-    std::unique_ptr<Expr> parseExpr() {
+    ExprId parseExpr() {
         auto expr = parseTerm();
         while (m_tok == Tok::ADD) {
             next();
-            expr = add(std::move(expr), parseTerm());
+            auto term = parseTerm();
+            expr = make(Add{expr, term});
         }
         return expr;
     }
 
     // T -> F { '*' }*
-    std::unique_ptr<Expr> parseTerm() {
+    ExprId parseTerm() {
         auto term = parseFactor();
         while (m_tok == Tok::MUL) {
             next();
-            term = mul(std::move(term), parseFactor());
+            auto factor = parseFactor();
+            term = make(Mul{term, factor});
         }
         return term;
     }
 
-    // F -> V | '(' E ')'
-    std::unique_ptr<Expr> parseFactor() {
+    // F -> V | N | '(' E ')'
+    ExprId parseFactor() {
         if (m_tok == Tok::VAR) {
-            auto factor = var(m_tok.value);
+            auto factor = make(Var{m_program.names.intern(m_tok.value)});
+            next();
+            return factor;
+        }
+        if (m_tok == Tok::NUM) {
+            auto factor = make(Literal{parseNumber()});
             next();
             return factor;
         }
@@ -187,17 +281,64 @@ private:
             next();
             return factor;
         }
-        throw std::invalid_argument(fmt::format("expected ')' or varname given {}", m_tok));
+        throw std::invalid_argument(fmt::format("expected ')', number or varname given {}", m_tok));
+    }
+
+    uint64_t parseNumber() const {
+        uint64_t value = 0;
+        for (char c : m_tok.value) {
+            uint64_t digit = c - '0';
+            if (value > (UINT64_MAX - digit) / 10)
+                throw std::invalid_argument(fmt::format("number {} is too large", m_tok));
+            value = value * 10 + digit;
+        }
+        return value;
     }
 
     Tokenizer m_tokenizer;
     Token m_tok;
+    Program m_program;
 };
 
 } // namespace
 
-std::list<Assign> parse(std::istream& is) {
-    return Parser(is).parse();
+NameId Names::intern(std::string_view name) {
+    if (2 * (m_spans.size() + 1) > m_slots.size())
+        rehash(std::max<size_t>(64, 2 * m_slots.size()));
+    auto mask = m_slots.size() - 1;
+    for (auto slot = std::hash<std::string_view>()(name) & mask; ; slot = (slot + 1) & mask) {
+        if (!m_slots[slot]) {
+            auto id = static_cast<NameId>(m_spans.size());
+            m_spans.emplace_back(static_cast<uint32_t>(m_chars.size()), static_cast<uint32_t>(name.size()));
+            m_chars.append(name);
+            m_slots[slot] = util::asInt(id) + 1;
+            return id;
+        }
+        auto id = static_cast<NameId>(m_slots[slot] - 1);
+        if ((*this)[id] == name)
+            return id;
+    }
+}
+
+void Names::rehash(size_t size) {
+    std::vector<uint32_t> slots(size);
+    auto mask = size - 1;
+    for (uint32_t i = 0; i < m_spans.size(); ++i) {
+        auto slot = std::hash<std::string_view>()((*this)[static_cast<NameId>(i)]) & mask;
+        while (slots[slot])
+            slot = (slot + 1) & mask;
+        slots[slot] = i + 1;
+    }
+    m_slots = std::move(slots);
+}
+
+Program parse(std::string_view text) {
+    return Parser(text).parse();
+}
+
+Program parse(std::istream& is) {
+    auto source = Source::fromStream(is);
+    return parse(source.text());
 }
 
 } // namespace ast
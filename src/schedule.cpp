@@ -1,32 +1,625 @@
 #include <exprc/schedule.h>
 
 #include <algorithm>
-#include <map>
+#include <array>
+#include <limits>
+#include <numeric>
+#include <optional>
+#include <queue>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
 
 #include <exprc/dfg.h>
 #include <exprc/ir.h>
 
 namespace exprc {
 
+Schedule::Schedule(const Dfg& dfg, std::vector<uint32_t> step_by_instr, uint32_t initiation_interval, UnitTiming timing)
+    : m_sequence(&dfg.sequence())
+    , m_initiation_interval(initiation_interval)
+    , m_timing(timing)
+    , m_step_by_instr(std::move(step_by_instr)) {
+    auto last_step = *std::max_element(m_step_by_instr.begin(), m_step_by_instr.end());
+    m_step_begin.assign(last_step + 2, 0);
+    for (auto step : m_step_by_instr)
+        ++m_step_begin[step + 1];
+    std::partial_sum(m_step_begin.begin(), m_step_begin.end(), m_step_begin.begin());
+    m_instrs.resize(m_step_by_instr.size());
+    std::vector<uint32_t> next(m_step_begin.begin(), m_step_begin.end() - 1);
+    for (auto id : dfg.topologicalOrder())
+        m_instrs[next[m_step_by_instr[util::asInt(id)]]++] = id;
+}
+
+uint32_t Schedule::peakUsage(Opcode opcode) const {
+    std::vector<uint32_t> used(m_initiation_interval ? m_initiation_interval : lastStep() + 1);
+    for (uint32_t step = 0; step <= lastStep(); ++step)
+        for (auto id : at(step)) {
+            auto& instr = (*m_sequence)[id];
+            if (instr.opcode != opcode)
+                continue;
+            for (uint32_t busy = 0; busy < m_timing.busy(instr); ++busy)
+                ++used[phaseOf(step + busy)];
+        }
+    return *std::max_element(used.begin(), used.end());
+}
+
+namespace {
+
+bool isOperation(const Instruction& instr) {
+    return instr.opcode == Opcode::ADD || instr.opcode == Opcode::MUL || instr.opcode == Opcode::MULC;
+}
+
+// inputs and constants are known before the first step
+bool isSource(const Instruction& instr) {
+    return instr.opcode == Opcode::INPUT || instr.opcode == Opcode::CONST;
+}
+
+// outputs go right after the last step executing operations, there is
+// at least one such step even if all outputs are given by inputs directly
+void placeOutputs(const Sequence& sequence, std::vector<uint32_t>& step_by_instr, uint32_t last_step) {
+    for (auto& instr : sequence)
+        if (instr.opcode == Opcode::OUTPUT)
+            step_by_instr[util::asInt(instr.id)] = std::max(last_step, 1u) + 1;
+}
+
+// cycles taken by operations on the longest path from the instruction to an output
+std::vector<uint32_t> criticalPath(const Sequence& sequence, const Dfg& dfg, const UnitTiming& timing) {
+    std::vector<uint32_t> length(sequence.size());
+    auto order = dfg.topologicalOrder();
+    for (auto it = order.end(); it != order.begin();) {
+        auto& instr = sequence[*--it];
+        uint32_t tail = 0;
+        for (auto succ : dfg.successors(instr))
+            tail = std::max(tail, length[util::asInt(succ)]);
+        length[util::asInt(instr.id)] = tail + (isOperation(instr) ? timing.latency(instr) : 0);
+    }
+    return length;
+}
+
+uint32_t criticalPathLength(const Sequence& sequence, const Dfg& dfg, const UnitTiming& timing) {
+    auto length = criticalPath(sequence, dfg, timing);
+    return *std::max_element(length.begin(), length.end());
+}
+
+// an operation may start in the step of its operands when the delays of the
+// chain leading to it leave enough of the clock period, delays are modelled
+// linear in width: as ripple carry adders and array multipliers, while
+// multipliers by constants are trees of adders, one per set bit of the constant;
+// a multi-cycle operation has as many clock periods as it takes cycles
+class Chaining {
+public:
+    Chaining(const Sequence& sequence, const Dfg& dfg, const ScheduleOptions& options)
+        : m_sequence(sequence)
+        , m_dfg(dfg)
+        , m_options(options)
+        , m_finish(sequence.size()) {
+        if (!enabled())
+            return;
+        for (auto& instr : sequence) {
+            if (delay(instr) <= period(instr))
+                continue;
+            auto cycles = options.timing.latency(instr);
+            if (cycles == 1)
+                throw std::invalid_argument(fmt::format("{} of {} bits takes {} ns, longer than the clock period of {} ns",
+                                                        toStr(instr.opcode), instr.width, delay(instr), options.clock_period));
+            throw std::invalid_argument(fmt::format("{} of {} bits takes {} ns, longer than {} cycles of {} ns",
+                                                    toStr(instr.opcode), instr.width, delay(instr), cycles, options.clock_period));
+        }
+    }
+
+    bool enabled() const {
+        return m_options.clock_period > 0;
+    }
+
+    // time into the step the operation starts at, if it fits into the step
+    // after its operands computed in the same step
+    std::optional<double> start(const Instruction& instr, uint32_t step, const std::vector<uint32_t>& step_by_instr) const {
+        double start = 0;
+        for (auto pred : m_dfg.predecessors(instr))
+            if (step_by_instr[util::asInt(pred)] == step && isOperation(m_sequence[pred])) {
+                if (!enabled())
+                    return std::nullopt;
+                start = std::max(start, m_finish[util::asInt(pred)]);
+            }
+        if (start > 0 && start + delay(instr) > period(instr))
+            return std::nullopt;
+        return start;
+    }
+
+    void place(const Instruction& instr, double start) {
+        m_finish[util::asInt(instr.id)] = start + delay(instr);
+    }
+
+private:
+    double period(const Instruction& instr) const {
+        return m_options.clock_period * m_options.timing.latency(instr);
+    }
+
+    double delay(const Instruction& instr) const {
+        auto scale = instr.width / 8.0;
+        switch (instr.opcode) {
+        case Opcode::ADD:
+            return m_options.add_delay * scale;
+        case Opcode::MUL:
+            return m_options.mul_delay * scale;
+        case Opcode::MULC: {
+            auto terms = static_cast<uint64_t>(__builtin_popcountll(instr.value));
+            auto levels = terms > 1 ? util::bitWidth(terms - 1) : 0;
+            return m_options.add_delay * scale * levels;
+        }
+        default:
+            return 0;
+        }
+    }
+
+    const Sequence& m_sequence;
+    const Dfg& m_dfg;
+    const ScheduleOptions& m_options;
+    // time into its step every operation is done at
+    std::vector<double> m_finish;
+};
+
+// the step an operation may start at after the operand is ready, results of
+// multi-cycle operations are registered before use and are never chained
+uint32_t readyStep(const Instruction& instr, uint32_t step, const UnitTiming& timing) {
+    auto latency = timing.latency(instr);
+    return latency == 1 ? step : step + latency;
+}
+
+// step to place outputs after, i.e. the last one an operation is done in
+uint32_t lastReadyStep(const Sequence& sequence, const std::vector<uint32_t>& step_by_instr, const UnitTiming& timing) {
+    uint32_t last = 0;
+    for (auto& instr : sequence)
+        if (isOperation(instr))
+            last = std::max(last, step_by_instr[util::asInt(instr.id)] + timing.latency(instr) - 1);
+    return last;
+}
+
+// earliest possible steps, outputs are left at zero step
+std::vector<uint32_t> asapSteps(const Sequence& sequence, const Dfg& dfg, Chaining& chaining, const UnitTiming& timing) {
+    std::vector<uint32_t> step_by_instr(sequence.size());
+    for (auto id : dfg.topologicalOrder()) {
+        auto& instr = sequence[id];
+        if (!isOperation(instr))
+            continue;
+        uint32_t step = 1;
+        for (auto pred : dfg.predecessors(instr))
+            step = std::max(step, readyStep(sequence[pred], step_by_instr[util::asInt(pred)], timing));
+        auto start = chaining.start(instr, step, step_by_instr);
+        if (!start) {
+            ++step;
+            start = 0;
+        }
+        step_by_instr[util::asInt(id)] = step;
+        chaining.place(instr, *start);
+    }
+    return step_by_instr;
+}
+
 // generates maximally parallel schedule scheduling things as early as possible
-std::multimap<uint32_t, std::reference_wrapper<const Instruction>> schedule(const std::list<Instruction>& sequence, const Dfg& dfg) {
-    std::multimap<uint32_t, std::reference_wrapper<const Instruction>> schedule;
-    std::unordered_map<Instruction::Id, uint32_t> earliest_step;
-    auto earliest = [&](const Instruction& instr) {
+Schedule scheduleAsap(const Sequence& sequence, const Dfg& dfg, const ScheduleOptions& options) {
+    Chaining chaining(sequence, dfg, options);
+    auto step_by_instr = asapSteps(sequence, dfg, chaining, options.timing);
+    placeOutputs(sequence, step_by_instr, lastReadyStep(sequence, step_by_instr, options.timing));
+    return Schedule(dfg, std::move(step_by_instr), 0, options.timing);
+}
+
+// list scheduling: every step takes ready operations with the longest path
+// to an output first, as long as functional units of their kind are left,
+// multiplications by constants are cheap and never limited; operations
+// released by ones issued are tried in the same step when chaining is enabled,
+// successors of multi-cycle ones are released when their results are ready;
+// units are reserved for the steps they are busy in, when pipelined steps of
+// the same phase share functional units as in a modulo reservation table
+Schedule scheduleList(const Sequence& sequence, const Dfg& dfg, const ScheduleOptions& options) {
+    struct Ready {
+        bool operator<(const Ready& other) const {
+            return std::tie(priority, other.position) < std::tie(other.priority, position);
+        }
+
+        uint32_t priority;
+        uint32_t position;
+        Instruction::Id id;
+    };
+
+    Chaining chaining(sequence, dfg, options);
+    auto& timing = options.timing;
+    auto priority = criticalPath(sequence, dfg, timing);
+    std::vector<uint32_t> position(sequence.size());
+    std::vector<uint32_t> pending(sequence.size());
+    for (uint32_t i = 0; i < dfg.topologicalOrder().size(); ++i) {
+        auto& instr = sequence[dfg.topologicalOrder()[i]];
+        position[util::asInt(instr.id)] = i;
+        pending[util::asInt(instr.id)] = dfg.fanIn(instr);
+    }
+
+    std::vector<uint32_t> step_by_instr(sequence.size());
+    std::priority_queue<Ready> ready_adds;
+    std::priority_queue<Ready> ready_muls;
+    std::priority_queue<Ready> ready_mulcs;
+    std::vector<Instruction::Id> released;
+    // multi-cycle operations by the step their results are ready at
+    std::vector<std::vector<Instruction::Id>> finishing;
+    size_t unscheduled = 0;
+    auto release = [&](const Instruction& instr) {
+        for (auto succ : dfg.successors(instr))
+            if (--pending[util::asInt(succ)] == 0 && sequence[succ].opcode != Opcode::OUTPUT)
+                released.push_back(succ);
+    };
+    for (auto& instr : sequence) {
+        if (isSource(instr))
+            release(instr);
+        else if (instr.opcode != Opcode::OUTPUT)
+            ++unscheduled;
+    }
+
+    auto ii = options.initiation_interval;
+    // adders and multipliers busy at every step, or at every phase when pipelined
+    std::vector<std::array<uint32_t, 2>> used(std::max(ii, 1u));
+    auto slot = [&](uint32_t step) -> std::array<uint32_t, 2>& {
+        if (ii)
+            return used[(step - 1) % ii];
+        if (step >= used.size())
+            used.resize(step + 1);
+        return used[step];
+    };
+    // operations of the same kind keep units busy for the same number of steps,
+    // so if the first ready one does not fit none does
+    auto fits = [&](const Instruction& instr, size_t kind, uint32_t limit, uint32_t step) {
+        for (uint32_t busy = 0; limit && busy < timing.busy(instr); ++busy)
+            if (slot(step + busy)[kind] >= limit)
+                return false;
+        return true;
+    };
+    auto issue = [&](std::priority_queue<Ready>& ready, size_t kind, uint32_t limit, uint32_t step) {
+        // operations chained too long for the clock period wait for the next step
+        std::vector<Ready> waiting;
+        while (!ready.empty() && fits(sequence[ready.top().id], kind, limit, step)) {
+            auto& instr = sequence[ready.top().id];
+            auto start = chaining.start(instr, step, step_by_instr);
+            if (!start) {
+                waiting.push_back(ready.top());
+                ready.pop();
+                continue;
+            }
+            ready.pop();
+            step_by_instr[util::asInt(instr.id)] = step;
+            chaining.place(instr, *start);
+            for (uint32_t busy = 0; limit && busy < timing.busy(instr); ++busy)
+                ++slot(step + busy)[kind];
+            auto latency = timing.latency(instr);
+            if (latency == 1)
+                release(instr);
+            else {
+                if (step + latency > finishing.size())
+                    finishing.resize(step + latency);
+                finishing[step + latency - 1].push_back(instr.id);
+            }
+            --unscheduled;
+        }
+        for (auto& instr : waiting)
+            ready.push(instr);
+    };
+    uint32_t step = 0;
+    while (unscheduled) {
+        ++step;
+        if (step - 1 < finishing.size())
+            for (auto id : finishing[step - 1])
+                release(sequence[id]);
+        do {
+            for (auto id : released) {
+                auto opcode = sequence[id].opcode;
+                auto& ready = (opcode == Opcode::ADD) ? ready_adds : (opcode == Opcode::MUL) ? ready_muls : ready_mulcs;
+                ready.push(Ready{priority[util::asInt(id)], position[util::asInt(id)], id});
+            }
+            released.clear();
+            issue(ready_adds, 0, options.max_adders, step);
+            issue(ready_muls, 1, options.max_multipliers, step);
+            issue(ready_mulcs, 0, 0, step);
+        } while (chaining.enabled() && !released.empty());
+    }
+    placeOutputs(sequence, step_by_instr, lastReadyStep(sequence, step_by_instr, timing));
+    return Schedule(dfg, std::move(step_by_instr), ii, timing);
+}
+
+// time constrained force directed scheduling (Paulin, Knight): operations are
+// fixed one at a time to the step where they least increase concurrency of their
+// kind, which is estimated from time frames of all operations; fixing one narrows
+// frames of operations depending on it only, so just those are redistributed and
+// only forces reading the steps they leave are computed again
+class ForceDirected {
+public:
+    ForceDirected(const Sequence& sequence, const Dfg& dfg, uint32_t latency, const UnitTiming& timing)
+        : m_sequence(sequence)
+        , m_dfg(dfg)
+        , m_latency(latency)
+        , m_timing(timing)
+        , m_order(dfg.topologicalOrder())
+        , m_position(sequence.size())
+        , m_asap(sequence.size())
+        , m_alap(sequence.size())
+        , m_fixed(sequence.size())
+        , m_changed_in(sequence.size())
+        , m_least(sequence.size())
+        , m_stale(sequence.size(), true) {
+        for (auto& dg : m_distribution)
+            dg.assign(latency + 2, 0.0);
+        for (uint32_t i = 0; i < m_order.size(); ++i)
+            m_position[util::asInt(m_order[i])] = i;
+        for (auto& instr : sequence)
+            m_fixed[util::asInt(instr.id)] = !isOperation(instr);
+        for (auto id : m_order)
+            if (!m_fixed[util::asInt(id)])
+                m_unfixed.push_back(id);
+        initFrames();
+        for (auto& instr : sequence)
+            if (isOperation(instr) && m_asap[util::asInt(instr.id)] + timing.latency(instr) - 1 > latency)
+                throw std::invalid_argument(fmt::format("latency {} is shorter than critical path of {} steps", latency, criticalPathLength(sequence, dfg, timing)));
+    }
+
+    Schedule run() {
+        for (auto& instr : m_sequence)
+            if (isOperation(instr))
+                distribute(instr, 1.0);
+        while (!m_unfixed.empty()) {
+            auto [id, step] = leastForce();
+            fix(id, step);
+        }
+        auto step_by_instr = std::move(m_asap);
+        placeOutputs(m_sequence, step_by_instr, m_latency);
+        return Schedule(m_dfg, std::move(step_by_instr), 0, m_timing);
+    }
+
+private:
+    struct Least {
+        double force = 0;
         uint32_t step = 0;
-        for (auto& op : instr.src)
-            step = std::max(step, earliest_step.at(dfg.definedBy(op)) + 1);
-        earliest_step.emplace(instr, step);
-        return step;
     };
-    for (auto& instr : sequence)
-        if (instr.opcode != Opcode::OUTPUT)
-            schedule.emplace(earliest(instr), instr);
-    auto last_step = schedule.rbegin()->first + 1;
-    for (auto& instr : sequence)
-        if (instr.opcode == Opcode::OUTPUT)
-            schedule.emplace(last_step, instr);
-    return schedule;
+
+    // frames of operations follow from the latency, inputs and constants
+    // stay at zero step and outputs right after the latency
+    void initFrames() {
+        for (auto id : m_order) {
+            auto& instr = m_sequence[id];
+            uint32_t asap = 0;
+            for (auto pred : m_dfg.predecessors(instr))
+                asap = std::max(asap, m_asap[util::asInt(pred)] + m_timing.latency(m_sequence[pred]));
+            m_asap[util::asInt(id)] = (instr.opcode == Opcode::OUTPUT) ? m_latency + 1 : asap;
+        }
+        for (auto it = m_order.end(); it != m_order.begin();) {
+            auto& instr = m_sequence[*--it];
+            auto alap = m_latency + 2;
+            for (auto succ : m_dfg.successors(instr))
+                alap = std::min(alap, m_alap[util::asInt(succ)]);
+            m_alap[util::asInt(instr.id)] = isSource(instr) ? 0 : alap - m_timing.latency(instr);
+        }
+    }
+
+    // fixes the operation and narrows frames of unfixed operations reachable
+    // from it, each in topological order so that it is narrowed once
+    void fix(Instruction::Id id, uint32_t step) {
+        ++m_round;
+        m_touched.fill({m_latency + 2, 0});
+        std::vector<Instruction::Id> changed;
+        auto change = [&](Instruction::Id id) {
+            if (m_changed_in[util::asInt(id)] == m_round)
+                return;
+            m_changed_in[util::asInt(id)] = m_round;
+            auto& instr = m_sequence[id];
+            distribute(instr, -1.0);
+            auto& touched = m_touched[kind(instr)];
+            touched.first = std::min(touched.first, m_asap[util::asInt(id)]);
+            touched.second = std::max(touched.second, m_alap[util::asInt(id)] + m_timing.busy(instr) - 1);
+            changed.push_back(id);
+        };
+        change(id);
+        m_asap[util::asInt(id)] = m_alap[util::asInt(id)] = step;
+        m_fixed[util::asInt(id)] = true;
+        auto earlier = [&](Instruction::Id a, Instruction::Id b) {
+            return m_position[util::asInt(a)] < m_position[util::asInt(b)];
+        };
+        m_unfixed.erase(std::lower_bound(m_unfixed.begin(), m_unfixed.end(), id, earlier));
+
+        auto later = [&](Instruction::Id a, Instruction::Id b) {
+            return earlier(b, a);
+        };
+        std::priority_queue<Instruction::Id, std::vector<Instruction::Id>, decltype(later)> forward(later);
+        for (forward.push(id); !forward.empty();) {
+            auto& instr = m_sequence[forward.top()];
+            for (forward.pop(); !forward.empty() && forward.top() == instr.id;)
+                forward.pop();
+            auto earliest = m_asap[util::asInt(instr.id)] + m_timing.latency(instr);
+            for (auto succ : m_dfg.successors(instr))
+                if (!m_fixed[util::asInt(succ)] && m_asap[util::asInt(succ)] < earliest) {
+                    change(succ);
+                    m_asap[util::asInt(succ)] = earliest;
+                    forward.push(succ);
+                }
+        }
+        std::priority_queue<Instruction::Id, std::vector<Instruction::Id>, decltype(earlier)> backward(earlier);
+        for (backward.push(id); !backward.empty();) {
+            auto& instr = m_sequence[backward.top()];
+            for (backward.pop(); !backward.empty() && backward.top() == instr.id;)
+                backward.pop();
+            for (auto pred : m_dfg.predecessors(instr)) {
+                auto latest = m_alap[util::asInt(instr.id)] - m_timing.latency(m_sequence[pred]);
+                if (!m_fixed[util::asInt(pred)] && m_alap[util::asInt(pred)] > latest) {
+                    change(pred);
+                    m_alap[util::asInt(pred)] = latest;
+                    backward.push(pred);
+                }
+            }
+        }
+        for (auto id : changed)
+            distribute(m_sequence[id], 1.0);
+
+        // forces read frames of operations and of their direct neighbours
+        auto stale = [&](const Instruction& instr) {
+            m_stale[util::asInt(instr.id)] = true;
+            for (auto pred : m_dfg.predecessors(instr))
+                m_stale[util::asInt(pred)] = true;
+            for (auto succ : m_dfg.successors(instr))
+                m_stale[util::asInt(succ)] = true;
+        };
+        stale(m_sequence[id]);
+        for (auto id : m_unfixed)
+            if (reads(m_sequence[id]))
+                stale(m_sequence[id]);
+    }
+
+    // whether the frame of the unfixed operation changed or it covers steps
+    // the last fixed operations left
+    bool reads(const Instruction& instr) const {
+        if (m_changed_in[util::asInt(instr.id)] == m_round)
+            return true;
+        auto& touched = m_touched[kind(instr)];
+        return m_asap[util::asInt(instr.id)] <= touched.second && touched.first <= m_alap[util::asInt(instr.id)];
+    }
+
+    static size_t kind(const Instruction& instr) {
+        return instr.opcode == Opcode::ADD ? 0 : instr.opcode == Opcode::MUL ? 1 : 2;
+    }
+
+    // prefix sums of distribution graphs, i.e. of probabilities of operations
+    // of each kind to be executed in a step, multi-cycle ones are counted in
+    // every step their units are busy in; the operation is added to them or
+    // taken away, which changes sums from its earliest step on
+    void distribute(const Instruction& instr, double sign) {
+        auto& dg = m_distribution[kind(instr)];
+        auto asap = m_asap[util::asInt(instr.id)];
+        auto alap = m_alap[util::asInt(instr.id)];
+        auto probability = sign / (alap - asap + 1);
+        auto busy = m_timing.busy(instr);
+        auto last = alap + busy - 1;
+        double current = 0, sum = 0;
+        for (auto step = asap; step < dg.size(); ++step) {
+            if (step <= last) {
+                if (step <= alap)
+                    current += probability;
+                if (step >= asap + busy)
+                    current -= probability;
+                sum += current;
+            }
+            dg[step] += sum;
+        }
+    }
+
+    // change of expected concurrency when frame of the operation is narrowed
+    double force(const Instruction& instr, uint32_t asap, uint32_t alap) const {
+        auto& dg = m_distribution[kind(instr)];
+        auto mean = [&](uint32_t begin, uint32_t end) {
+            return (dg[end] - dg[begin - 1]) / (end - begin + 1);
+        };
+        return mean(asap, alap) - mean(m_asap[util::asInt(instr.id)], m_alap[util::asInt(instr.id)]);
+    }
+
+    // self force of placing the operation plus forces of narrowing frames
+    // of its direct predecessors and successors
+    double force(const Instruction& instr, uint32_t step) const {
+        auto total = force(instr, step, step);
+        for (auto pred : m_dfg.predecessors(instr)) {
+            auto latest = step - m_timing.latency(m_sequence[pred]);
+            if (!m_fixed[util::asInt(pred)] && m_alap[util::asInt(pred)] > latest)
+                total += force(m_sequence[pred], m_asap[util::asInt(pred)], latest);
+        }
+        for (auto succ : m_dfg.successors(instr)) {
+            auto earliest = step + m_timing.latency(instr);
+            if (!m_fixed[util::asInt(succ)] && m_asap[util::asInt(succ)] < earliest)
+                total += force(m_sequence[succ], earliest, m_alap[util::asInt(succ)]);
+        }
+        return total;
+    }
+
+    // tolerance keeps ties resolved towards earlier operations and steps
+    static bool less(double value, double least) {
+        return value < least - 1e-9;
+    }
+
+    std::tuple<Instruction::Id, uint32_t> leastForce() {
+        std::tuple<Instruction::Id, uint32_t> best;
+        auto least = std::numeric_limits<double>::infinity();
+        for (auto id : m_unfixed) {
+            auto& instr = m_sequence[id];
+            auto& own = m_least[util::asInt(id)];
+            if (m_stale[util::asInt(id)]) {
+                own.force = std::numeric_limits<double>::infinity();
+                for (auto step = m_asap[util::asInt(id)]; step <= m_alap[util::asInt(id)]; ++step) {
+                    auto value = force(instr, step);
+                    if (less(value, own.force))
+                        own = {value, step};
+                }
+                m_stale[util::asInt(id)] = false;
+            }
+            if (less(own.force, least)) {
+                least = own.force;
+                best = std::make_tuple(id, own.step);
+            }
+        }
+        return best;
+    }
+
+    const Sequence& m_sequence;
+    const Dfg& m_dfg;
+    const uint32_t m_latency;
+    const UnitTiming m_timing;
+    const util::Span<Instruction::Id> m_order;
+    std::vector<uint32_t> m_position;
+    std::vector<uint32_t> m_asap;
+    std::vector<uint32_t> m_alap;
+    std::vector<bool> m_fixed;
+    // in topological order
+    std::vector<Instruction::Id> m_unfixed;
+    std::array<std::vector<double>, 3> m_distribution;
+    // operations whose frames changed in the round are marked by it, steps
+    // they left are touched for each kind
+    uint32_t m_round = 0;
+    std::vector<uint32_t> m_changed_in;
+    std::array<std::pair<uint32_t, uint32_t>, 3> m_touched;
+    // force and step each operation is least placed at, while not stale
+    std::vector<Least> m_least;
+    std::vector<bool> m_stale;
+};
+
+// every kind of operations has to fit into functional units allowed for
+// it used at each phase of the initiation interval, multiplications by
+// constants are not limited; units busy for a few cycles could leave no
+// room for each other in the interval, so multi-cycle ones are pipelined
+Schedule scheduleModulo(const Sequence& sequence, const Dfg& dfg, ScheduleOptions options) {
+    auto ii = options.initiation_interval;
+    auto& timing = options.timing;
+    if (timing.mul_latency > 1 && !timing.pipelined_mul)
+        throw std::invalid_argument(fmt::format("multipliers taking {} cycles have to be pipelined in a pipelined data path", timing.mul_latency));
+    auto fit = [&](Opcode opcode, uint32_t& limit, const char* units) {
+        auto count = static_cast<uint32_t>(std::count_if(sequence.begin(), sequence.end(), [&](auto& instr) {
+            return instr.opcode == opcode;
+        }));
+        if (!limit)
+            limit = (count + ii - 1) / ii;
+        else if (count > limit * ii)
+            throw std::invalid_argument(fmt::format("initiation interval {} is infeasible with {} {}: {} operations need initiation interval of {} at least",
+                                                    ii, limit, units, count, (count + limit - 1) / limit));
+    };
+    fit(Opcode::ADD, options.max_adders, "adders");
+    fit(Opcode::MUL, options.max_multipliers, "multipliers");
+    return scheduleList(sequence, dfg, options);
+}
+
+} // namespace
+
+Schedule schedule(const Sequence& sequence, const Dfg& dfg, const ScheduleOptions& options) {
+    if (options.initiation_interval)
+        return scheduleModulo(sequence, dfg, options);
+    if (options.force_directed) {
+        auto latency = options.latency ? options.latency : criticalPathLength(sequence, dfg, options.timing);
+        return ForceDirected(sequence, dfg, latency, options.timing).run();
+    }
+    if (options.max_adders || options.max_multipliers)
+        return scheduleList(sequence, dfg, options);
+    return scheduleAsap(sequence, dfg, options);
 }
 
 } // namespace exprc
@@ -0,0 +1,372 @@
+#include <exprc/sim.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <exprc/util.h>
+
+namespace exprc {
+
+namespace sim {
+
+namespace {
+
+uint64_t maskOf(uint32_t width) {
+    return width < 64 ? (uint64_t(1) << width) - 1 : ~uint64_t(0);
+}
+
+// what an in port belongs to
+struct InPortInfo {
+    enum class Sink : uint8_t {
+        NONE,
+        UNIT,
+        REGISTER,
+        OUTPUT,
+    };
+
+    Sink sink = Sink::NONE;
+    // index of the unit or output, operand of the unit
+    uint32_t index = 0;
+    uint32_t operand = 0;
+    // out port of the register
+    uint32_t out = 0;
+    uint64_t mask = 0;
+};
+
+} // namespace
+
+Simulator::Simulator(const DataPath& data_path)
+    : m_last_state(static_cast<uint32_t>(data_path.drivers.size() - 2))
+    , m_initiation_interval(data_path.initiation_interval)
+    , m_latency(data_path.latency) {
+    compile(data_path);
+}
+
+// drivers of every state are turned into ops of functional units in order of
+// chaining and writes of registers, so that a cycle is a pass over arrays
+void Simulator::compile(const DataPath& data_path) {
+    struct Unit {
+        Op::Kind kind;
+        uint32_t out;
+        uint64_t mask;
+        uint64_t value;
+        // index of the pipeline of a pipelined multiplier
+        uint32_t pipeline;
+    };
+
+    std::vector<Unit> units;
+    std::vector<InPortInfo> in_ports;
+    uint32_t out_ports = 0;
+    auto addOut = [&](const dev::OutPort& out) {
+        out_ports = std::max(out_ports, util::asInt(out.id) + 1);
+        return util::asInt(out.id);
+    };
+    auto addIn = [&](const dev::InPort& in, InPortInfo info) {
+        auto id = util::asInt(in.id);
+        if (id >= in_ports.size())
+            in_ports.resize(id + 1);
+        in_ports[id] = info;
+    };
+    auto addUnit = [&](auto& device, Op::Kind kind, uint64_t value, std::string name) {
+        auto index = static_cast<uint32_t>(units.size());
+        uint32_t operand = 0;
+        for (auto& in : device.in)
+            addIn(in, {InPortInfo::Sink::UNIT, index, operand++, 0, maskOf(device.width)});
+        units.push_back({kind, addOut(device.out), maskOf(device.width), value, 0});
+        m_units.emplace_back(std::move(name), std::vector<uint32_t>());
+    };
+
+    for (auto& input : data_path.inputs)
+        m_inputs.emplace_back(addOut(input.out), maskOf(input.width));
+    for (auto& constant : data_path.constants)
+        addOut(constant.out);
+    for (auto& p : data_path.registers)
+        addIn(p.second.in[0], {InPortInfo::Sink::REGISTER, 0, 0, addOut(p.second.out), maskOf(p.second.width)});
+    uint32_t index = 0;
+    for (auto& output : data_path.outputs)
+        addIn(output.in[0], {InPortInfo::Sink::OUTPUT, index++, 0, 0, maskOf(output.width)});
+    for (auto& adder : data_path.adders)
+        addUnit(adder, Op::Kind::ADD, 0, fmt::format("add{}", util::asInt(adder.id)));
+    for (auto& multiplier : data_path.multipliers) {
+        auto pipelined = multiplier.pipelined && multiplier.latency > 1;
+        addUnit(multiplier, pipelined ? Op::Kind::ISSUE : Op::Kind::MUL, 0, fmt::format("mul{}", util::asInt(multiplier.id)));
+        if (pipelined) {
+            auto first = static_cast<uint32_t>(m_stages.size());
+            units.back().pipeline = static_cast<uint32_t>(m_pipelines.size());
+            m_pipelines.push_back({units.back().out, first, multiplier.latency});
+            m_stages.resize(first + multiplier.latency);
+        }
+    }
+    for (auto& multiplier : data_path.const_multipliers)
+        addUnit(multiplier, Op::Kind::MULC, multiplier.value, fmt::format("mulc{}", util::asInt(multiplier.id)));
+
+    m_values.assign(out_ports, 0);
+    for (auto& constant : data_path.constants)
+        m_values[util::asInt(constant.out.id)] = constant.value & maskOf(constant.width);
+
+    // units of a state with their operands, stamped with the state
+    std::vector<uint32_t> operands(units.size() * 2);
+    std::vector<uint32_t> driven_in(units.size(), 0);
+    // unit computing an out port in the state, if not pipelined
+    std::vector<uint32_t> computed_by(out_ports, UINT32_MAX);
+    // 0 not visited, 1 being ordered, 2 ordered
+    std::vector<uint8_t> mark(units.size());
+    // write of a register in the state and writes reading the register
+    std::vector<uint32_t> written_by(out_ports, UINT32_MAX);
+    std::vector<std::vector<uint32_t>> readers;
+    std::vector<uint8_t> write_mark;
+
+    m_op_begin.push_back(0);
+    m_write_begin.push_back(0);
+    m_staged.push_back(false);
+    for (uint32_t state = 1; state <= m_last_state; ++state) {
+        std::vector<uint32_t> driven;
+        for (auto [in, out] : data_path.drivers[state]) {
+            auto& info = in_ports[util::asInt(in)];
+            if (info.sink == InPortInfo::Sink::REGISTER)
+                m_writes.push_back({info.out, util::asInt(out), info.mask});
+            if (info.sink != InPortInfo::Sink::UNIT)
+                continue;
+            if (driven_in[info.index] != state) {
+                driven_in[info.index] = state;
+                operands[info.index * 2] = operands[info.index * 2 + 1] = util::asInt(out);
+                driven.push_back(info.index);
+            }
+            operands[info.index * 2 + info.operand] = util::asInt(out);
+        }
+        for (auto unit : driven) {
+            if (units[unit].kind != Op::Kind::ISSUE)
+                computed_by[units[unit].out] = unit;
+            mark[unit] = 0;
+            m_units[unit].second.push_back(state);
+        }
+        // chained units go after the ones they take results of
+        auto order = [&](uint32_t unit, auto& order) -> void {
+            if (mark[unit] == 2)
+                return;
+            if (mark[unit] == 1)
+                throw std::invalid_argument(fmt::format("combinational loop through {} in state S{}", m_units[unit].first, state));
+            mark[unit] = 1;
+            auto& u = units[unit];
+            auto a = operands[unit * 2];
+            auto b = operands[unit * 2 + 1];
+            for (auto src : {a, b})
+                if (computed_by[src] != UINT32_MAX)
+                    order(computed_by[src], order);
+            mark[unit] = 2;
+            auto res = u.kind == Op::Kind::ISSUE ? m_pipelines[u.pipeline].first : u.out;
+            m_ops.push_back({u.kind, res, a, b, u.mask, u.value});
+        };
+        for (auto unit : driven)
+            order(unit, order);
+        for (auto unit : driven)
+            computed_by[units[unit].out] = UINT32_MAX;
+        m_op_begin.push_back(static_cast<uint32_t>(m_ops.size()));
+        m_staged.push_back(!orderWrites(written_by, readers, write_mark));
+        m_write_begin.push_back(static_cast<uint32_t>(m_writes.size()));
+    }
+
+    m_outputs.resize(data_path.outputs.size());
+    for (auto [in, out] : data_path.drivers.back()) {
+        auto& info = in_ports[util::asInt(in)];
+        if (info.sink == InPortInfo::Sink::OUTPUT)
+            m_outputs[info.index] = {info.index, util::asInt(out), info.mask};
+    }
+    m_next.resize(m_writes.size());
+}
+
+// a register read by others in the state is written after them, so that all
+// of them take values of the cycle without copies, unless they make a cycle
+bool Simulator::orderWrites(std::vector<uint32_t>& written_by, std::vector<std::vector<uint32_t>>& readers, std::vector<uint8_t>& mark) {
+    auto begin = m_write_begin.back();
+    auto count = static_cast<uint32_t>(m_writes.size()) - begin;
+    std::vector<Write> writes(m_writes.begin() + begin, m_writes.end());
+    for (uint32_t i = 0; i < count; ++i)
+        written_by[writes[i].dst] = i;
+    readers.assign(count, {});
+    for (uint32_t i = 0; i < count; ++i)
+        if (written_by[writes[i].src] != UINT32_MAX)
+            readers[written_by[writes[i].src]].push_back(i);
+    for (uint32_t i = 0; i < count; ++i)
+        written_by[writes[i].dst] = UINT32_MAX;
+
+    mark.assign(count, 0);
+    m_writes.resize(begin);
+    auto order = [&](uint32_t write, auto& order) -> bool {
+        if (mark[write] == 1)
+            return false;
+        if (mark[write] == 2)
+            return true;
+        mark[write] = 1;
+        for (auto reader : readers[write])
+            if (!order(reader, order))
+                return false;
+        mark[write] = 2;
+        m_writes.push_back(writes[write]);
+        return true;
+    };
+    for (uint32_t i = 0; i < count; ++i)
+        if (!order(i, order)) {
+            m_writes.resize(begin);
+            m_writes.insert(m_writes.end(), writes.begin(), writes.end());
+            return false;
+        }
+    return true;
+}
+
+void Simulator::step(uint32_t state) {
+    auto* values = m_values.data();
+    for (auto op = m_ops.data() + m_op_begin[state - 1], end = m_ops.data() + m_op_begin[state]; op != end; ++op) {
+        switch (op->kind) {
+        case Op::Kind::ADD:
+            values[op->res] = (values[op->a] + values[op->b]) & op->mask;
+            break;
+        case Op::Kind::MUL:
+            values[op->res] = (values[op->a] * values[op->b]) & op->mask;
+            break;
+        case Op::Kind::MULC:
+            values[op->res] = (values[op->a] * op->value) & op->mask;
+            break;
+        case Op::Kind::ISSUE:
+            m_stages[op->res] = (values[op->a] * values[op->b]) & op->mask;
+            break;
+        }
+    }
+    // registers take values of the cycle, before any of them changes
+    auto begin = m_write_begin[state - 1];
+    auto end = m_write_begin[state];
+    if (m_staged[state])
+        for (auto i = begin; i != end; ++i)
+            m_next[i] = values[m_writes[i].src] & m_writes[i].mask;
+    else
+        for (auto i = begin; i != end; ++i)
+            values[m_writes[i].dst] = values[m_writes[i].src] & m_writes[i].mask;
+    for (auto& pipeline : m_pipelines) {
+        auto* stages = m_stages.data() + pipeline.first;
+        for (auto i = pipeline.stages - 1; i > 0; --i)
+            stages[i] = stages[i - 1];
+        stages[0] = 0;
+        values[pipeline.out] = stages[pipeline.stages - 1];
+    }
+    if (m_staged[state])
+        for (auto i = begin; i != end; ++i)
+            values[m_writes[i].dst] = m_next[i];
+}
+
+void Simulator::setInputs(const uint64_t* values) {
+    for (auto [out, mask] : m_inputs)
+        m_values[out] = *values++ & mask;
+}
+
+void Simulator::getOutputs(uint64_t* values) {
+    for (auto& output : m_outputs)
+        values[output.dst] = m_values[output.src] & output.mask;
+}
+
+Stats Simulator::run(util::Span<uint64_t> inputs, std::vector<uint64_t>& outputs) {
+    if (m_inputs.empty() || inputs.size() % m_inputs.size())
+        throw std::invalid_argument(fmt::format("expected vectors of {} inputs given {} values", m_inputs.size(), inputs.size()));
+    Stats stats;
+    stats.vectors = inputs.size() / m_inputs.size();
+    outputs.resize(stats.vectors * m_outputs.size());
+    std::vector<uint64_t> visits(m_last_state + 1, 0);
+    if (!stats.vectors)
+        return stats;
+
+    if (!m_initiation_interval) {
+        // the state machine is back in the first state when outputs are done
+        for (uint64_t vector = 0; vector < stats.vectors; ++vector) {
+            setInputs(inputs.begin() + vector * m_inputs.size());
+            for (uint32_t state = 1; state <= m_last_state; ++state)
+                step(state);
+            getOutputs(outputs.data() + vector * m_outputs.size());
+        }
+        std::fill(visits.begin() + 1, visits.end(), stats.vectors);
+        stats.cycles = stats.vectors * m_last_state;
+        stats.latency = stats.interval = m_last_state;
+    }
+    else {
+        // states are phases, inputs are taken in the first one and outputs
+        // are done latency cycles later, while next inputs are on the way
+        uint64_t taken = 0;
+        uint64_t done = 0;
+        for (uint64_t cycle = 0;; ++cycle) {
+            if (cycle >= m_latency && (cycle - m_latency) % m_initiation_interval == 0) {
+                getOutputs(outputs.data() + done * m_outputs.size());
+                if (++done == stats.vectors) {
+                    stats.cycles = cycle;
+                    break;
+                }
+            }
+            auto phase = static_cast<uint32_t>(cycle % m_initiation_interval) + 1;
+            if (phase == 1 && taken < stats.vectors)
+                setInputs(inputs.begin() + taken++ * m_inputs.size());
+            step(phase);
+            ++visits[phase];
+        }
+        stats.latency = m_latency;
+        stats.interval = m_initiation_interval;
+    }
+
+    for (auto& [name, states] : m_units) {
+        uint64_t busy = 0;
+        for (auto state : states)
+            busy += visits[state];
+        stats.busy.emplace_back(name, busy);
+    }
+    return stats;
+}
+
+std::vector<uint64_t> parseVectors(std::string_view text, size_t inputs) {
+    if (!inputs)
+        throw std::invalid_argument("design takes no inputs to simulate");
+    std::vector<uint64_t> values;
+    auto* cur = text.data();
+    auto* end = cur + text.size();
+    for (uint32_t line = 1; cur != end; ++line) {
+        size_t count = 0;
+        while (cur != end && *cur != '\n') {
+            if (*cur == ' ' || *cur == '\t' || *cur == '\r') {
+                ++cur;
+                continue;
+            }
+            if (*cur == '#') {
+                while (cur != end && *cur != '\n')
+                    ++cur;
+                break;
+            }
+            auto* begin = cur;
+            while (cur != end && *cur != ' ' && *cur != '\t' && *cur != '\r' && *cur != '\n' && *cur != '#')
+                ++cur;
+            std::string_view word(begin, cur - begin);
+            auto hex = word.size() > 2 && word[0] == '0' && (word[1] == 'x' || word[1] == 'X');
+            uint64_t base = hex ? 16 : 10;
+            uint64_t value = 0;
+            for (auto c : word.substr(hex ? 2 : 0)) {
+                uint64_t digit = (c >= '0' && c <= '9') ? c - '0'
+                               : (hex && c >= 'a' && c <= 'f') ? c - 'a' + 10
+                               : (hex && c >= 'A' && c <= 'F') ? c - 'A' + 10
+                               : base;
+                if (digit >= base || value > (UINT64_MAX - digit) / base)
+                    throw std::invalid_argument(fmt::format("invalid value '{}' at line {}", word, line));
+                value = value * base + digit;
+            }
+            values.push_back(value);
+            ++count;
+        }
+        if (count && count != inputs)
+            throw std::invalid_argument(fmt::format("expected {} values given {} at line {}", inputs, count, line));
+        if (cur != end)
+            ++cur;
+    }
+    return values;
+}
+
+} // namespace sim
+
+} // namespace exprc
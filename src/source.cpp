@@ -0,0 +1,72 @@
+#include <exprc/source.h>
+
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fmt/format.h>
+
+namespace exprc {
+
+Source::Source(Source&& other) noexcept
+    : m_buf(std::move(other.m_buf))
+    , m_map(std::exchange(other.m_map, nullptr))
+    , m_map_size(std::exchange(other.m_map_size, 0)) {
+    // moved string may keep its characters inline, so the view is rebuilt
+    m_text = m_map ? std::exchange(other.m_text, {}) : std::string_view(m_buf);
+    other.m_text = {};
+}
+
+Source::~Source() {
+    if (m_map)
+        ::munmap(m_map, m_map_size);
+}
+
+Source Source::fromFile(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        throw std::invalid_argument(fmt::format("can not open {}: {}", path, std::strerror(errno)));
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        auto size = static_cast<size_t>(st.st_size);
+        auto* map = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map != MAP_FAILED) {
+            ::close(fd);
+            ::madvise(map, size, MADV_SEQUENTIAL);
+            Source source;
+            source.m_map = map;
+            source.m_map_size = size;
+            source.m_text = std::string_view(static_cast<const char*>(map), size);
+            return source;
+        }
+    }
+    ::close(fd);
+    std::ifstream stream(path, std::ios::binary);
+    return fromStream(stream);
+}
+
+Source Source::fromStream(std::istream& is) {
+    std::string buf;
+    char chunk[1 << 16];
+    while (is.read(chunk, sizeof(chunk)) || is.gcount() > 0)
+        buf.append(chunk, static_cast<size_t>(is.gcount()));
+    return fromString(std::move(buf));
+}
+
+Source Source::fromString(std::string text) {
+    Source source;
+    source.m_buf = std::move(text);
+    source.m_text = source.m_buf;
+    return source;
+}
+
+} // namespace exprc
@@ -0,0 +1,147 @@
+#include <exprc/stats.h>
+
+#include <ctime>
+#include <iterator>
+
+#include <sys/resource.h>
+
+#include <fmt/format.h>
+
+namespace exprc {
+
+namespace stats {
+
+namespace {
+
+// constant initialised, so usable by operator new before anything else runs
+thread_local Allocations t_allocations;
+
+double threadCpuSeconds() {
+    timespec time{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &time);
+    return static_cast<double>(time.tv_sec) + static_cast<double>(time.tv_nsec) / 1e9;
+}
+
+std::string mebibytes(uint64_t bytes) {
+    return fmt::format("{:.1f} MiB", static_cast<double>(bytes) / (1 << 20));
+}
+
+} // namespace
+
+const Allocations& threadAllocations() {
+    return t_allocations;
+}
+
+void countAllocation(size_t bytes) {
+    ++t_allocations.count;
+    t_allocations.bytes += bytes;
+}
+
+void PassTimer::start(const char* name) {
+    auto now = std::chrono::steady_clock::now();
+    if (m_passes.empty())
+        m_first = now;
+    Pass pass;
+    pass.name = name;
+    pass.start = std::chrono::duration<double>(now - m_first).count();
+    m_passes.push_back(pass);
+    m_allocations = t_allocations;
+    m_cpu = threadCpuSeconds();
+    m_wall = std::chrono::steady_clock::now();
+}
+
+void PassTimer::stop() {
+    auto wall = std::chrono::steady_clock::now();
+    auto cpu = threadCpuSeconds();
+    auto& pass = m_passes.back();
+    pass.wall = std::chrono::duration<double>(wall - m_wall).count();
+    pass.cpu = cpu - m_cpu;
+    pass.allocations = t_allocations.count - m_allocations.count;
+    pass.allocated_bytes = t_allocations.bytes - m_allocations.bytes;
+}
+
+Design design(const Sequence& sequence, const Schedule& sched, const DataPath& data_path) {
+    Design design;
+    design.instructions = sequence.size();
+    design.steps = sched.latency();
+    design.initiation_interval = sched.initiationInterval();
+    design.adders = data_path.adders.size();
+    design.multipliers = data_path.multipliers.size();
+    design.const_multipliers = data_path.const_multipliers.size();
+    design.registers = data_path.registers.size();
+    for (auto& [id, reg] : data_path.registers)
+        design.register_bits += reg.width;
+    design.mux_inputs = countMuxInputs(data_path);
+    return design;
+}
+
+uint64_t peakRss() {
+    rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    // kilobytes on Linux
+    return static_cast<uint64_t>(usage.ru_maxrss) * 1024;
+}
+
+void printPasses(std::ostream& os, const Report& report) {
+    fmt::memory_buffer buf;
+    fmt::format_to(std::back_inserter(buf), "{:<10} {:>10} {:>10} {:>12} {:>14}\n", "pass", "wall ms", "cpu ms", "allocations", "bytes");
+    Pass total{"total"};
+    for (auto& pass : report.passes) {
+        fmt::format_to(std::back_inserter(buf), "{:<10} {:>10.3f} {:>10.3f} {:>12} {:>14}\n", pass.name, pass.wall * 1e3, pass.cpu * 1e3,
+                       pass.allocations, pass.allocated_bytes);
+        total.wall += pass.wall;
+        total.cpu += pass.cpu;
+        total.allocations += pass.allocations;
+        total.allocated_bytes += pass.allocated_bytes;
+    }
+    fmt::format_to(std::back_inserter(buf), "{:<10} {:>10.3f} {:>10.3f} {:>12} {:>14}\n", total.name, total.wall * 1e3, total.cpu * 1e3,
+                   total.allocations, total.allocated_bytes);
+    fmt::format_to(std::back_inserter(buf), "peak rss: {}\n", mebibytes(report.peak_rss));
+    os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+}
+
+void printDesign(std::ostream& os, const Design& design) {
+    auto ii = design.initiation_interval ? fmt::format(", II {}", design.initiation_interval) : std::string();
+    os << fmt::format("design: {} instructions, {} steps{}, {} adders, {} multipliers, {} constant multipliers, {} registers ({} bits), {} mux inputs",
+                      design.instructions, design.steps, ii, design.adders, design.multipliers, design.const_multipliers, design.registers,
+                      design.register_bits, design.mux_inputs) << std::endl;
+}
+
+void writeJson(std::ostream& os, const Report& report) {
+    fmt::memory_buffer buf;
+    fmt::format_to(std::back_inserter(buf), "{{\n  \"passes\": [");
+    for (size_t i = 0; i < report.passes.size(); ++i) {
+        auto& pass = report.passes[i];
+        fmt::format_to(std::back_inserter(buf),
+                       "{}\n    {{\"name\": \"{}\", \"start_s\": {:.6f}, \"wall_s\": {:.6f}, \"cpu_s\": {:.6f}, \"allocations\": {}, \"allocated_bytes\": {}}}",
+                       i ? "," : "", pass.name, pass.start, pass.wall, pass.cpu, pass.allocations, pass.allocated_bytes);
+    }
+    fmt::format_to(std::back_inserter(buf), "\n  ],\n");
+    if (auto& design = report.design) {
+        fmt::format_to(std::back_inserter(buf),
+                       "  \"design\": {{\"instructions\": {}, \"steps\": {}, \"initiation_interval\": {}, \"adders\": {}, \"multipliers\": {}, "
+                       "\"const_multipliers\": {}, \"registers\": {}, \"register_bits\": {}, \"mux_inputs\": {}}},\n",
+                       design->instructions, design->steps, design->initiation_interval, design->adders, design->multipliers,
+                       design->const_multipliers, design->registers, design->register_bits, design->mux_inputs);
+    }
+    fmt::format_to(std::back_inserter(buf), "  \"peak_rss_bytes\": {}\n}}\n", report.peak_rss);
+    os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+}
+
+void writeTrace(std::ostream& os, const Report& report) {
+    fmt::memory_buffer buf;
+    fmt::format_to(std::back_inserter(buf), "{{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    for (size_t i = 0; i < report.passes.size(); ++i) {
+        auto& pass = report.passes[i];
+        fmt::format_to(std::back_inserter(buf),
+                       "{}\n  {{\"name\": \"{}\", \"cat\": \"pass\", \"ph\": \"X\", \"pid\": 1, \"tid\": 1, \"ts\": {:.3f}, \"dur\": {:.3f}, "
+                       "\"args\": {{\"cpu_us\": {:.3f}, \"allocations\": {}, \"allocated_bytes\": {}}}}}",
+                       i ? "," : "", pass.name, pass.start * 1e6, pass.wall * 1e6, pass.cpu * 1e6, pass.allocations, pass.allocated_bytes);
+    }
+    fmt::format_to(std::back_inserter(buf), "\n]}}\n");
+    os.write(buf.data(), static_cast<std::streamsize>(buf.size()));
+}
+
+} // namespace stats
+
+} // namespace exprc
@@ -1,11 +1,16 @@
 #include <exprc/translate.h>
 
-#include <list>
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <queue>
 #include <stdexcept>
 #include <string>
 #include <tuple>
 #include <variant>
 #include <unordered_map>
+#include <vector>
 
 #include <fmt/format.h>
 
@@ -16,12 +21,62 @@ namespace exprc {
 
 namespace {
 
+// operation on given operands, those of commutative ones are ordered,
+// the second one is the immediate of instructions having it
+struct ValueKey {
+    bool operator==(const ValueKey& other) const {
+        return std::tie(opcode, a, b) == std::tie(other.opcode, other.a, other.b);
+    }
+
+    Opcode opcode;
+    Operand::Id a;
+    uint64_t b;
+};
+
+struct ValueKeyHash {
+    size_t operator()(const ValueKey& key) const {
+        auto operands = (uint64_t(util::asInt(key.a)) << 32) ^ key.b;
+        return std::hash<uint64_t>()(operands * 0x9e3779b97f4a7c15ull + static_cast<uint64_t>(key.opcode));
+    }
+};
+
+// value of an expression is either computed by an instruction or a constant,
+// which becomes an instruction only when an operation takes it as an operand
+using Value = std::variant<Operand::Id, uint64_t>;
+
+const uint64_t* constant(const Value& value) {
+    return std::get_if<uint64_t>(&value);
+}
+
 class Translate {
 public:
-    auto translate(const std::list<ast::Assign>& program) {
-        for (auto& assign : program)
+    Translate(const ast::Program& program, const TranslateOptions& options)
+        : m_program(program)
+        , m_options(options)
+        , m_oper_by_name(program.names.size())
+        , m_used(program.names.size())
+        , m_inner(program.exprs.size())
+        , m_mask(options.width < MAX_WIDTH ? (uint64_t(1) << options.width) - 1 : ~uint64_t(0)) {
+        if (options.width < 1 || options.width > MAX_WIDTH)
+            throw std::invalid_argument(fmt::format("width {} is out of range [1, {}]", options.width, MAX_WIDTH));
+        m_values.reserve(program.exprs.size());
+        if (options.reassociate)
+            for (auto& expr : program.exprs)
+                std::visit([&](auto& expr) {
+                    markInner(expr);
+                }, expr);
+    }
+
+    auto translate() {
+        for (auto& assign : m_program.assigns)
             translateAssign(assign);
-        return std::make_tuple(std::move(m_sequence), std::move(m_name_by_oper));
+        if (!m_has_output)
+            throw std::invalid_argument("program has no 'out' assignments");
+        for (auto& assign : m_program.assigns)
+            if (auto* var = std::get_if<ast::AssignVar>(&assign); var && !m_used[util::asInt(var->name)])
+                throw std::invalid_argument(fmt::format("variable {} is not used neither in 'out' statement nor in another expression", name(var->name)));
+        eliminateDeadCode();
+        return std::make_tuple(Sequence(std::move(m_sequence), m_context.count<Operand>()), std::move(m_names), m_reused);
     }
 
 private:
@@ -32,70 +87,330 @@ private:
     }
 
     void translateAssign(const ast::AssignVar& assign) {
-        auto res = translateExpr(*assign.expr);
-        auto redefined = !m_oper_by_name.emplace(assign.name, res).second;
-        if (redefined)
-            throw std::invalid_argument(fmt::format("variable {} defined more than once", assign.name));
-        m_name_by_oper.emplace(res, assign.name);
+        auto res = translateExprs(assign.expr);
+        if (!define(assign.name, res))
+            throw std::invalid_argument(fmt::format("variable {} defined more than once", name(assign.name)));
     }
 
     void translateAssign(const ast::AssignOut& assign) {
-        auto res = translateExpr(*assign.expr);
-        auto redefined = !m_oper_by_name.emplace(assign.name, res).second;
-        if (redefined)
-            throw std::invalid_argument(fmt::format("output variable {} defined more than once", assign.name));
-        m_name_by_oper.emplace(res, assign.name);
-        addInstr(Opcode::OUTPUT, std::optional<Operand>(), std::vector({res}));
+        auto res = translateExprs(assign.expr);
+        if (!define(assign.name, res))
+            throw std::invalid_argument(fmt::format("output variable {} defined more than once", name(assign.name)));
+        m_has_output = true;
+        auto src = operand(res);
+        auto width = m_options.full_precision ? this->width(src.id) : m_options.width;
+        auto& output = addInstr(Opcode::OUTPUT, std::optional<Operand>(), Instruction::Sources{src}, uint64_t(0), width);
+        m_names.outputs.emplace(output.id, name(assign.name));
+    }
+
+    // inputs are made when declared, as well as when used first if not declared
+    void translateAssign(const ast::DeclareIn& declare) {
+        if (m_oper_by_name[util::asInt(declare.name)])
+            throw std::invalid_argument(fmt::format("variable {} is already defined or used, so can not be declared as input", name(declare.name)));
+        makeInput(declare.name, declare.width);
+    }
+
+    // expressions are stored in post order, so operands of every expression
+    // up to the assigned one are translated by the time it is reached,
+    // inner nodes of chains are translated along with their roots
+    Value translateExprs(ast::ExprId last) {
+        while (m_values.size() <= util::asInt(last)) {
+            auto id = m_values.size();
+            if (m_inner[id])
+                m_values.emplace_back();
+            else
+                m_values.emplace_back(translateExpr(m_program[static_cast<ast::ExprId>(id)]));
+        }
+        return value(last);
+    }
+
+    void markInner(const ast::Var&) {
+    }
+
+    void markInner(const ast::Literal&) {
+    }
+
+    // an operation which is an operand of the same one belongs to its chain
+    template <typename Op>
+    void markInner(const Op& op) {
+        for (auto operand : {op.a, op.b})
+            if (std::holds_alternative<Op>(m_program[operand]))
+                m_inner[util::asInt(operand)] = true;
     }
 
-    Operand translateExpr(const ast::Expr& expr) {
+    Value translateExpr(const ast::Expr& expr) {
         return std::visit([&](auto& expr) {
             return translateExpr(expr);
         }, expr);
     }
 
-    Operand translateExpr(const ast::Add& add) {
-        auto opA = translateExpr(*add.a);
-        auto opB = translateExpr(*add.b);
-        auto res = m_context.make<Operand>();
-        addInstr(Opcode::ADD, res, std::vector({opA, opB}));
+    Value translateExpr(const ast::Add& add) {
+        if (m_options.reassociate)
+            return translateChain(Opcode::ADD, add);
+        return makeOperation(Opcode::ADD, value(add.a), value(add.b));
+    }
+
+    Value translateExpr(const ast::Mul& mul) {
+        if (m_options.reassociate)
+            return translateChain(Opcode::MUL, mul);
+        return makeOperation(Opcode::MUL, value(mul.a), value(mul.b));
+    }
+
+    // tree height reduction: a chain of the same associative and commutative
+    // operation is flattened and rebuilt combining the two operands which are
+    // ready first, i.e. have the least arrival step, what gives the tree of
+    // the least height; operands keep their order within every operation,
+    // constants of the chain are folded into one taking the place of the first
+    template <typename Op>
+    Value translateChain(Opcode opcode, const Op& root) {
+        struct Leaf {
+            bool operator>(const Leaf& other) const {
+                return std::tie(arrival, position) > std::tie(other.arrival, other.position);
+            }
+
+            uint32_t arrival;
+            uint32_t position;
+            Value value;
+        };
+
+        std::vector<Leaf> operands;
+        std::optional<Leaf> folded;
+        std::vector<ast::ExprId> stack{root.b, root.a};
+        for (uint32_t position = 0; !stack.empty(); ++position) {
+            auto id = stack.back();
+            stack.pop_back();
+            if (auto* op = std::get_if<Op>(&m_program[id])) {
+                stack.push_back(op->b);
+                stack.push_back(op->a);
+                continue;
+            }
+            auto leaf = value(id);
+            if (auto* c = constant(leaf))
+                folded = folded ? Leaf{0, folded->position, fold(opcode, *constant(folded->value), *c)} : Leaf{0, position, leaf};
+            else
+                operands.push_back(Leaf{arrival(leaf), position, leaf});
+        }
+        // absorbing zero leaves nothing to compute
+        if (folded && opcode == Opcode::MUL && *constant(folded->value) == 0)
+            return folded->value;
+        if (folded)
+            operands.push_back(*folded);
+        std::priority_queue<Leaf, std::vector<Leaf>, std::greater<Leaf>> leaves(std::greater<Leaf>(), std::move(operands));
+        while (leaves.size() > 1) {
+            auto a = leaves.top();
+            leaves.pop();
+            auto b = leaves.top();
+            leaves.pop();
+            if (b.position < a.position)
+                std::swap(a, b);
+            auto res = makeOperation(opcode, a.value, b.value);
+            leaves.push(Leaf{arrival(res), a.position, res});
+        }
+        return leaves.top().value;
+    }
+
+    // constants wrap around at the width of outputs as any other value,
+    // in full precision they only have to fit into MAX_WIDTH bits
+    uint64_t fold(Opcode opcode, uint64_t a, uint64_t b) const {
+        uint64_t res;
+        auto overflow = (opcode == Opcode::ADD) ? __builtin_add_overflow(a, b, &res) : __builtin_mul_overflow(a, b, &res);
+        if (!m_options.full_precision)
+            return res & m_mask;
+        if (overflow)
+            throw std::invalid_argument(fmt::format("constant {} {} {} exceeds {} bits", a, opcode == Opcode::ADD ? '+' : '*', b, MAX_WIDTH));
+        return res;
+    }
+
+    // the least width holding every result of an operation on values of
+    // given widths, wrapping values are cut at the width of outputs
+    uint32_t resultWidth(Opcode opcode, uint32_t a, uint32_t b) const {
+        auto width = (opcode == Opcode::ADD) ? std::max(a, b) + 1 : a + b;
+        if (!m_options.full_precision)
+            return std::min(width, m_options.width);
+        if (width > MAX_WIDTH)
+            throw std::invalid_argument(fmt::format("value of {} bits exceeds {} bits", width, MAX_WIDTH));
+        return width;
+    }
+
+    // operations on constants are folded and identities are simplified away:
+    // x+0 and x*1 give x, x*0 gives 0, while the rest of multiplications by
+    // constants become MULC, which needs no general multiplier
+    Value makeOperation(Opcode opcode, Value a, Value b) {
+        if (constant(a) && constant(b))
+            return fold(opcode, *constant(a), *constant(b));
+        auto* c = constant(a) ? constant(a) : constant(b);
+        auto& other = constant(a) ? b : a;
+        if (c && *c == 0)
+            return (opcode == Opcode::ADD) ? other : Value(uint64_t(0));
+        if (c && *c == 1 && opcode == Opcode::MUL)
+            return other;
+        if (c && opcode == Opcode::MUL)
+            return makeInstr(Opcode::MULC, operand(other), *c).id;
+        return makeInstr(opcode, operand(a), operand(b)).id;
+    }
+
+    // value numbering by hash consing: the same operation on the same operands
+    // gives the value already computed, both + and * are commutative
+    Operand makeInstr(Opcode opcode, Operand opA, Operand opB) {
+        auto [a, b] = std::minmax(opA.id, opB.id);
+        auto width = resultWidth(opcode, this->width(opA.id), this->width(opB.id));
+        auto [res, made] = makeValue(ValueKey{opcode, a, util::asInt(b)}, std::max(arrival(opA), arrival(opB)) + 1, width);
+        if (made)
+            addInstr(opcode, res, Instruction::Sources{opA, opB}, uint64_t(0), width);
+        else
+            ++m_reused;
         return res;
     }
 
-    Operand translateExpr(const ast::Mul& mul) {
-        auto opA = translateExpr(*mul.a);
-        auto opB = translateExpr(*mul.b);
+    Operand makeInstr(Opcode opcode, Operand op, uint64_t immediate) {
+        auto width = resultWidth(Opcode::MUL, this->width(op.id), util::bitWidth(immediate));
+        auto [res, made] = makeValue(ValueKey{opcode, op.id, immediate}, arrival(op) + 1, width);
+        if (made)
+            addInstr(opcode, res, Instruction::Sources{op}, immediate, width);
+        else
+            ++m_reused;
+        return res;
+    }
+
+    std::tuple<Operand, bool> makeValue(const ValueKey& key, uint32_t arrival, uint32_t width) {
+        auto [it, inserted] = m_value_numbers.try_emplace(key, Operand::Id::FIRST_VALID_ID);
+        if (!inserted)
+            return {Operand{it->second}, false};
         auto res = m_context.make<Operand>();
-        addInstr(Opcode::MUL, res, std::vector({opA, opB}));
+        it->second = res.id;
+        m_arrival.push_back(arrival);
+        m_widths.push_back(width);
+        return {res, true};
+    }
+
+    // constants are numbered too, so every one is made once
+    Operand operand(const Value& value) {
+        auto* c = constant(value);
+        if (!c)
+            return Operand{std::get<Operand::Id>(value)};
+        auto width = util::bitWidth(*c);
+        auto [res, made] = makeValue(ValueKey{Opcode::CONST, Operand::Id::FIRST_VALID_ID, *c}, 0, width);
+        if (made)
+            addInstr(Opcode::CONST, res, Instruction::Sources(), *c, width);
         return res;
     }
 
-    Operand translateExpr(const ast::Var& var) {
-        auto it = m_oper_by_name.find(var.name);
-        if (it != m_oper_by_name.end())
-            return it->second;
+    Value translateExpr(const ast::Literal& literal) {
+        return m_options.full_precision ? literal.value : literal.value & m_mask;
+    }
+
+    Value translateExpr(const ast::Var& var) {
+        m_used[util::asInt(var.name)] = true;
+        if (auto& defined = m_oper_by_name[util::asInt(var.name)])
+            return *defined;
+        return makeInput(var.name, m_options.width);
+    }
+
+    Operand::Id makeInput(ast::NameId name, uint32_t width) {
         auto op = m_context.make<Operand>();
-        addInstr(Opcode::INPUT, op, std::vector<Operand>());
-        m_oper_by_name.emplace(var.name, op);
-        m_name_by_oper.emplace(op, var.name);
-        return op;
+        m_arrival.push_back(0);
+        m_widths.push_back(width);
+        addInstr(Opcode::INPUT, op, Instruction::Sources(), uint64_t(0), width);
+        m_oper_by_name[util::asInt(name)].emplace(op.id);
+        m_names.inputs.emplace(op, this->name(name));
+        return op.id;
+    }
+
+    Value value(ast::ExprId expr) const {
+        return m_values[util::asInt(expr)].value();
+    }
+
+    uint32_t width(Operand::Id id) const {
+        return m_widths[util::asInt(id)];
+    }
+
+    // the earliest step the value may be computed at
+    uint32_t arrival(const Value& value) const {
+        auto* id = std::get_if<Operand::Id>(&value);
+        return id ? m_arrival[util::asInt(*id)] : 0;
+    }
+
+    bool define(ast::NameId name, const Value& value) {
+        auto& defined = m_oper_by_name[util::asInt(name)];
+        if (defined)
+            return false;
+        defined.emplace(value);
+        return true;
+    }
+
+    // folding leaves operations whose results are no longer used, those are
+    // dropped and the rest are renumbered, unused inputs stay as module ports
+    void eliminateDeadCode() {
+        std::vector<bool> live(m_context.count<Operand>());
+        auto dead = false;
+        for (auto it = m_sequence.rbegin(); it != m_sequence.rend(); ++it) {
+            if (it->dst && it->opcode != Opcode::INPUT && !live[util::asInt(it->dst->id)]) {
+                dead = true;
+                continue;
+            }
+            for (auto& src : it->src)
+                live[util::asInt(src.id)] = true;
+        }
+        if (!dead)
+            return;
+        Context context;
+        std::vector<Instruction> sequence;
+        NameTable names;
+        std::vector<std::optional<Operand>> renamed(live.size());
+        for (auto& instr : m_sequence) {
+            if (instr.dst && instr.opcode != Opcode::INPUT && !live[util::asInt(instr.dst->id)])
+                continue;
+            Instruction::Sources src;
+            for (auto& op : instr.src)
+                src.push_back(renamed[util::asInt(op.id)].value());
+            std::optional<Operand> dst;
+            if (instr.dst)
+                dst.emplace(renamed[util::asInt(instr.dst->id)].emplace(context.make<Operand>()));
+            auto& copy = sequence.emplace_back(context.make<Instruction>(instr.opcode, dst, src, instr.value, instr.width));
+            if (instr.opcode == Opcode::INPUT)
+                names.inputs.emplace(*dst, m_names.inputs.at(*instr.dst));
+            else if (instr.opcode == Opcode::OUTPUT)
+                names.outputs.emplace(copy.id, m_names.outputs.at(instr.id));
+        }
+        m_context = context;
+        m_sequence = std::move(sequence);
+        m_names = std::move(names);
+    }
+
+    std::string name(ast::NameId name) const {
+        return std::string(m_program.names[name]);
     }
 
     template <typename... Args>
-    void addInstr(Args&&... args) {
-        m_sequence.emplace_back(m_context.make<Instruction>(std::forward<Args>(args)...));
+    const Instruction& addInstr(Args&&... args) {
+        return m_sequence.emplace_back(m_context.make<Instruction>(std::forward<Args>(args)...));
     }
 
+    const ast::Program& m_program;
+    const TranslateOptions& m_options;
     Context m_context;
-    std::list<Instruction> m_sequence;
-    std::unordered_map<std::string, const Operand> m_oper_by_name;
-    std::unordered_map<Operand::Id, const std::string> m_name_by_oper;
+    std::vector<Instruction> m_sequence;
+    // values of expressions, inner nodes of chains have none
+    std::vector<std::optional<Value>> m_values;
+    std::vector<std::optional<Value>> m_oper_by_name;
+    // variables referred to by expressions, indexed by name id
+    std::vector<bool> m_used;
+    // operations which are operands of the same ones, indexed by expression id
+    std::vector<bool> m_inner;
+    const uint64_t m_mask;
+    // indexed by operand id
+    std::vector<uint32_t> m_arrival;
+    std::vector<uint32_t> m_widths;
+    std::unordered_map<ValueKey, Operand::Id, ValueKeyHash> m_value_numbers;
+    uint32_t m_reused = 0;
+    NameTable m_names;
+    bool m_has_output = false;
 };
 
 } // namespace
 
-std::tuple<std::list<Instruction>, std::unordered_map<Operand::Id, const std::string>> translate(const std::list<ast::Assign>& program) {
-    return Translate().translate(program);
+std::tuple<Sequence, NameTable, uint32_t> translate(const ast::Program& program, const TranslateOptions& options) {
+    return Translate(program, options).translate();
 }
 
 } // namespace exprc
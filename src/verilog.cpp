@@ -1,11 +1,14 @@
 #include <exprc/verilog.h>
 
+#include <algorithm>
+#include <iterator>
 #include <ostream>
-#include <unordered_set>
+#include <stdexcept>
+#include <string>
+#include <string_view>
 #include <utility>
-#include <set>
+#include <vector>
 
-#include <fmt/ostream.h>
 #include <fmt/format.h>
 
 #include <exprc/alloc.h>
@@ -19,12 +22,12 @@ namespace {
 
 // XXX: last control step contains only output assignments and is not really executed
 
-auto lastState(const std::map<std::tuple<uint32_t, dev::InPort::Id>, dev::OutPort::Id>& drivers) {
-    return std::get<0>(drivers.rbegin()->first) - 1;
+auto lastState(const std::vector<std::vector<Driver>>& drivers) {
+    return static_cast<uint32_t>(drivers.size() - 2);
 }
 
-auto outState(const std::map<std::tuple<uint32_t, dev::InPort::Id>, dev::OutPort::Id>& drivers) {
-    return std::get<0>(drivers.rbegin()->first);
+auto outState(const std::vector<std::vector<Driver>>& drivers) {
+    return static_cast<uint32_t>(drivers.size() - 1);
 }
 
 auto msb(uint32_t val) {
@@ -35,54 +38,228 @@ auto msb(uint32_t val) {
     return msb;
 }
 
+// keywords of Verilog-2005 and signals of the module besides program ports
+constexpr std::string_view reserved_names[] = {
+    "always", "and", "assign", "automatic", "begin", "buf", "bufif0", "bufif1", "case", "casex", "casez", "cell", "cmos",
+    "config", "deassign", "default", "defparam", "design", "disable", "edge", "else", "end", "endcase", "endconfig",
+    "endfunction", "endgenerate", "endmodule", "endprimitive", "endspecify", "endtable", "endtask", "event", "for",
+    "force", "forever", "fork", "function", "generate", "genvar", "highz0", "highz1", "if", "ifnone", "incdir",
+    "include", "initial", "inout", "input", "instance", "integer", "join", "large", "liblist", "library", "localparam",
+    "macromodule", "medium", "module", "nand", "negedge", "nmos", "nor", "noshowcancelled", "not", "notif0", "notif1",
+    "or", "output", "parameter", "pmos", "posedge", "primitive", "pull0", "pull1", "pulldown", "pullup",
+    "pulsestyle_ondetect", "pulsestyle_onevent", "rcmos", "real", "realtime", "reg", "release", "repeat", "rnmos",
+    "rpmos", "rtran", "rtranif0", "rtranif1", "scalared", "showcancelled", "signed", "small", "specify", "specparam",
+    "strong0", "strong1", "supply0", "supply1", "table", "task", "time", "tran", "tranif0", "tranif1", "tri", "tri0",
+    "tri1", "triand", "trior", "trireg", "unsigned", "use", "uwire", "vectored", "wait", "wand", "weak0", "weak1",
+    "while", "wire", "wor", "xnor", "xor",
+    "clk", "rst", "ena", "done", "ready", "state", "valid",
+};
+
+// strips the suffix and the number following it off the name, e.g. _in3
+bool stripNumbered(std::string_view& name, std::string_view suffix) {
+    auto end = name.find_last_not_of("0123456789") + 1;
+    if (end == name.size() || end < suffix.size() || name.substr(end - suffix.size(), suffix.size()) != suffix)
+        return false;
+    name = name.substr(0, end - suffix.size());
+    return true;
+}
+
+// names made for states, devices, their in ports and stages of pipelined
+// multipliers, e.g. S1, reg0, add2_in5 or mul1_stage2
+bool isNameOfModule(std::string_view name) {
+    if (!stripNumbered(name, "_in"))
+        stripNumbered(name, "_stage");
+    for (std::string_view prefix : {"S", "reg", "add", "mul", "mulc", "const"}) {
+        auto device = name;
+        if (stripNumbered(device, prefix) && device.empty())
+            return true;
+    }
+    return false;
+}
+
 class Dumper {
+    // what an in port belongs to
+    enum class Sink : uint8_t {
+        UNIT,
+        REGISTER,
+        OUTPUT,
+    };
+
+    struct InPortInfo {
+        std::string name;
+        uint32_t width = 0;
+        Sink sink = Sink::UNIT;
+    };
+
 public:
-    Dumper(std::ostream& os, const DataPath& data_path)
+    Dumper(std::ostream& os, const DataPath& data_path, const DumpOptions& options)
         : m_os(os)
+        , m_options(options)
         , m_inputs(data_path.inputs)
         , m_outputs(data_path.outputs)
+        , m_constants(data_path.constants)
         , m_adders(data_path.adders)
         , m_multipliers(data_path.multipliers)
-        , m_registers(data_path.registers) {
+        , m_const_multipliers(data_path.const_multipliers)
+        , m_registers(data_path.registers)
+        , m_drivers(data_path.drivers) {
+        for (auto& input : m_inputs)
+            checkName(input.name, "input");
+        for (auto& output : m_outputs)
+            checkName(output.name, "output");
         fillPortInfo(data_path);
         fillControlInfo(data_path);
     }
 
+    // the whole module is formatted in memory and written at once
     void dump() {
+        dumpModule();
+        m_os.write(m_buf.data(), static_cast<std::streamsize>(m_buf.size()));
+    }
+
+private:
+    void dumpModule() {
         print("module exprc(\n");
         print("  input wire clk,\n");
         print("  input wire rst,\n");
         print("  input wire ena,\n");
         for (auto& input : m_inputs)
-            print("  input wire [7:0] {},\n", name(input));
+            print("  input wire [{}:0] {},\n", input.width - 1, name(input));
         for (auto& output : m_outputs)
-            print("  output wire [7:0] {},\n", name(output));
-        print("  output reg done,\n");
-        print("  output reg ready\n");
+            print("  output wire [{}:0] {},\n", output.width - 1, name(output));
+        print("  output {} done,\n", m_initiation_interval ? "wire" : "reg");
+        print("  output {} ready\n", m_initiation_interval ? "wire" : "reg");
         print(");\n\n");
         print("  localparam [0:{}]\n", m_state_msb);
         for (uint32_t state = 1; state <= m_last_state; ++state)
             print("    S{} = {}'d{}{}\n", state, m_state_msb + 1, state - 1, state != m_last_state ? "," : ";");
         for (auto& p : m_registers)
-            print("  reg [7:0] {};\n", name(p.second));
+            print("  reg [{}:0] {};\n", p.second.width - 1, name(p.second));
+        for (auto& constant : m_constants)
+            print("  wire [{}:0] {} = {}'d{};\n", constant.width - 1, name(constant), constant.width, constant.value);
         print("\n");
         for (auto& adder : m_adders) {
             for (auto& in : adder.in)
-                print("  reg [7:0] {};\n", name(in));
-            print("  wire [7:0] {} = {} + {};\n", name(adder.out), name(adder.in[0]), name(adder.in[1]));
+                print("  reg [{}:0] {};\n", adder.width - 1, name(in));
+            print("  wire [{}:0] {} = {} + {};\n", adder.width - 1, name(adder.out), name(adder.in[0]), name(adder.in[1]));
             print("\n");
         }
         for (auto& multiplier : m_multipliers) {
             for (auto& in : multiplier.in)
-                print("  reg [7:0] {};\n", name(in));
-            print("  wire [7:0] {} = {} * {};\n", name(multiplier.out), name(multiplier.in[0]), name(multiplier.in[1]));
+                print("  reg [{}:0] {};\n", multiplier.width - 1, name(in));
+            if (multiplier.pipelined && multiplier.latency > 1)
+                dumpPipelinedMultiplier(multiplier);
+            else
+                print("  wire [{}:0] {} = {} * {};\n", multiplier.width - 1, name(multiplier.out), name(multiplier.in[0]), name(multiplier.in[1]));
             print("\n");
         }
-        for (auto& p : m_drivers_by_state.equal_range(m_out_state)) {
-            auto [in, driver] = p.second;
-            print("  assign {} = {};\n", name(in), (name(driver)));
+        for (auto& multiplier : m_const_multipliers) {
+            print("  reg [{}:0] {};\n", multiplier.width - 1, name(multiplier.in[0]));
+            print("  wire [{}:0] {} = {} * {}'d{};\n", multiplier.width - 1, name(multiplier.out), name(multiplier.in[0]),
+                  util::bitWidth(multiplier.value), multiplier.value);
+            print("\n");
         }
+        for (auto [in, driver] : m_drivers[m_out_state])
+            print("  assign {} = {};\n", name(in), (name(driver)));
         print("\n");
+        if (m_initiation_interval)
+            dumpPipelineControl();
+        else
+            dumpControl();
+        if (m_options.case_muxes)
+            dumpCaseMuxes();
+        else
+            dumpStateMuxes();
+        print("endmodule\n");
+    }
+
+    // in ports of functional units are driven in a case over states, those
+    // not used in a state are X either in the state or by default up front
+    void dumpStateMuxes() {
+        // states driving no in ports of functional units are left out if compact
+        std::vector<uint32_t> states;
+        for (uint32_t state = 1; state <= m_last_state; ++state)
+            if (!m_options.compact || std::any_of(m_drivers[state].begin(), m_drivers[state].end(), [&](auto& driver) {
+                    return !isRegPort(driver.in);
+                }))
+                states.push_back(state);
+        print("  always @(*)\n");
+        print("    begin\n");
+        if (m_options.compact)
+            for (auto in : m_unit_ports)
+                print("      {} = {}'dX;\n", name(in), width(in));
+        if (states.empty()) {
+            print("    end\n\n");
+            return;
+        }
+        print("      case (state)\n");
+        for (auto state : states) {
+            print("        S{}:\n", state);
+            print("          begin\n");
+            for (auto [in, driver] : m_drivers[state]) {
+                if (!isRegPort(in))
+                    print("            {} = {};\n", name(in), name(driver));
+                m_assigned_in[util::asInt(in)] = state;
+            }
+            if (!m_options.compact)
+                for (auto in : m_unit_ports)
+                    if (m_assigned_in[util::asInt(in)] != state)
+                        print("            {} = {}'dX;\n", name(in), width(in));
+            print("          end\n");
+        }
+        print("      endcase\n");
+        print("    end\n\n");
+    }
+
+    // every in port of a functional unit gets a multiplexer of its own, which
+    // lists states by the out port driving the in port in them
+    void dumpCaseMuxes() {
+        std::vector<std::vector<std::pair<dev::OutPort::Id, std::vector<uint32_t>>>> drivers(m_in_ports.size());
+        for (uint32_t state = 1; state <= m_last_state; ++state)
+            for (auto [in, out] : m_drivers[state]) {
+                if (isRegPort(in))
+                    continue;
+                auto& sources = drivers[util::asInt(in)];
+                auto it = std::find_if(sources.begin(), sources.end(), [&](auto& source) {
+                    return source.first == out;
+                });
+                if (it == sources.end())
+                    it = sources.emplace(sources.end(), out, std::vector<uint32_t>());
+                it->second.push_back(state);
+            }
+        for (auto in : m_unit_ports) {
+            print("  always @(*)\n");
+            print("    case (state)\n");
+            for (auto& [out, states] : drivers[util::asInt(in)]) {
+                print("      ");
+                for (size_t i = 0; i < states.size(); ++i)
+                    print("{}S{}", i ? ", " : "", states[i]);
+                print(": {} = {};\n", name(in), name(out));
+            }
+            print("      default: {} = {}'dX;\n", name(in), width(in));
+            print("    endcase\n\n");
+        }
+    }
+
+    // the product is registered once per cycle but the last one, synthesis
+    // retimes these registers into the multiplier; a multi-cycle multiplier
+    // which is not pipelined is a plain one with its operands held stable
+    void dumpPipelinedMultiplier(const dev::Multiplier& multiplier) {
+        auto stage = [&](uint32_t index) {
+            return fmt::format("{}_stage{}", name(multiplier), index);
+        };
+        for (uint32_t index = 1; index < multiplier.latency; ++index)
+            print("  reg [{}:0] {};\n", multiplier.width - 1, stage(index));
+        print("  wire [{}:0] {} = {};\n", multiplier.width - 1, name(multiplier.out), stage(multiplier.latency - 1));
+        print("  always @(posedge clk)\n");
+        print("    begin\n");
+        print("      {} <= {} * {};\n", stage(1), name(multiplier.in[0]), name(multiplier.in[1]));
+        for (uint32_t index = 2; index < multiplier.latency; ++index)
+            print("      {} <= {};\n", stage(index), stage(index - 1));
+        print("    end\n");
+    }
+
+    void dumpControl() {
         print("  reg [0:{}] state;\n", m_state_msb);
         print("  always @(posedge clk)\n");
         print("    begin\n");
@@ -108,11 +285,9 @@ public:
             }
             else
                 print("              state <= S{};\n", state == m_last_state ? 1 : state + 1);
-            for (auto& p : m_drivers_by_state.equal_range(state)) {
-                auto [in, driver] = p.second;
+            for (auto [in, driver] : m_drivers[state])
                 if (isRegPort(in))
                     print("              {} <= {};\n", name(in), name(driver));
-            }
             if (state == m_last_state) {
                 print("              done <= 1'b1;\n");
                 print("              ready <= 1'b1;\n");
@@ -122,76 +297,109 @@ public:
         print("        endcase\n");
         print("      end\n");
         print("    end\n\n");
-        print("  always @(*)\n");
+    }
+
+    // states are phases of the initiation interval, every one of them writes
+    // registers unconditionally and valid bits follow accepted inputs
+    void dumpPipelineControl() {
+        print("  reg [0:{}] state;\n", m_state_msb);
+        print("  reg [{}:0] valid;\n", m_latency - 1);
+        print("  assign ready = state == S1;\n");
+        print("  assign done = valid[{}];\n", m_latency - 1);
+        print("  always @(posedge clk)\n");
         print("    begin\n");
-        print("      case (state)\n");
+        print("      if (rst)\n");
+        print("        begin\n");
+        print("          state <= S1;\n");
+        print("          valid <= {}'d0;\n", m_latency);
+        print("        end\n");
+        print("    else\n");
+        print("      begin\n");
+        if (m_latency == 1)
+            print("        valid <= ena && ready;\n");
+        else
+            print("        valid <= {{valid[{}:0], ena && ready}};\n", m_latency - 2);
+        print("        case (state)\n");
         for (uint32_t state = 1; state <= m_last_state; ++state) {
-            print("        S{}:\n", state);
-            print("          begin\n");
-            std::unordered_set<dev::InPort::Id> assigned;
-            for (auto& p : m_drivers_by_state.equal_range(state)) {
-                auto [in, driver] = p.second;
-                if (!isRegPort(in))
-                    print("            {} = {};\n", name(in), name(driver));
-                assigned.emplace(in);
-            }
-            for (auto in : m_in_ports)
-                if (assigned.find(in) == assigned.end() && !isRegPort(in) && !isOutput(in))
-                    print("            {} = 8'dX;\n", name(in));
-            print("          end\n");
+            print("          S{}:\n", state);
+            print("            begin\n");
+            print("              state <= S{};\n", state == m_last_state ? 1 : state + 1);
+            for (auto [in, driver] : m_drivers[state])
+                if (isRegPort(in))
+                    print("              {} <= {};\n", name(in), name(driver));
+            print("            end\n");
         }
-        print("      endcase\n");
+        print("        endcase\n");
+        print("      end\n");
         print("    end\n\n");
-        print("endmodule\n");
     }
 
-private:
+    // ports take names of the program as they are
+    static void checkName(const std::string& name, const char* port) {
+        if (std::find(std::begin(reserved_names), std::end(reserved_names), name) != std::end(reserved_names) || isNameOfModule(name))
+            throw std::invalid_argument(fmt::format("{} '{}' takes a name reserved in verilog", port, name));
+    }
+
     template <typename... Args>
     void print(Args&&... args) {
-        fmt::print(m_os, std::forward<Args>(args)...);
+        fmt::format_to(std::back_inserter(m_buf), std::forward<Args>(args)...);
     }
 
+    // ports are named over and over in every state, so names are made once
+    // into tables indexed by port ids, which are dense as the context hands
+    // them out one after another
     void fillPortInfo(const DataPath& data_path) {
-        auto add = [&](auto& device) {
-            if constexpr (!std::is_same_v<std::decay_t<decltype(device)>, dev::Output>)
-                m_device_by_port.emplace(device.out, device);
+        auto add = [&](auto& device, Sink sink) {
+            using Device = std::decay_t<decltype(device)>;
+            auto device_name = name(device);
+            if constexpr (!std::is_same_v<Device, dev::Output>) {
+                auto out = util::asInt(device.out.id);
+                if (out >= m_out_names.size())
+                    m_out_names.resize(out + 1);
+                m_out_names[out] = device_name;
+            }
             for (auto& in : device.in) {
-                m_device_by_port.emplace(in, device);
-                m_in_ports.emplace(in);
+                auto index = util::asInt(in.id);
+                if (index >= m_in_ports.size())
+                    m_in_ports.resize(index + 1);
+                auto in_name = (sink == Sink::UNIT) ? fmt::format("{}_in{}", device_name, index) : device_name;
+                m_in_ports[index] = InPortInfo{std::move(in_name), device.width, sink};
+                if (sink == Sink::UNIT)
+                    m_unit_ports.push_back(in.id);
             }
         };
         for (auto& input : data_path.inputs)
-            add(input);
-        for (auto& output : data_path.outputs) {
-            add(output);
-            m_output_ports.emplace(output.in[0]);
-        }
-        for (auto& p : data_path.registers) {
-            add(p.second);
-            m_reg_ports.emplace(p.second.in[0]);
-        }
+            add(input, Sink::UNIT);
+        for (auto& constant : data_path.constants)
+            add(constant, Sink::UNIT);
+        for (auto& output : data_path.outputs)
+            add(output, Sink::OUTPUT);
+        for (auto& p : data_path.registers)
+            add(p.second, Sink::REGISTER);
         for (auto& adder : data_path.adders)
-            add(adder);
+            add(adder, Sink::UNIT);
         for (auto& multiplier : data_path.multipliers)
-            add(multiplier);
+            add(multiplier, Sink::UNIT);
+        for (auto& multiplier : data_path.const_multipliers)
+            add(multiplier, Sink::UNIT);
+        std::sort(m_unit_ports.begin(), m_unit_ports.end());
+        m_assigned_in.assign(m_in_ports.size(), 0);
     }
 
     void fillControlInfo(const DataPath& data_path) {
         m_last_state = lastState(data_path.drivers);
         m_out_state = outState(data_path.drivers);
         m_state_msb = msb(m_last_state);
-        for (auto& [assign, driver] : data_path.drivers) {
-            auto& [step, port] = assign;
-            m_drivers_by_state.emplace(step, std::make_tuple(port, driver));
-        }
+        m_initiation_interval = data_path.initiation_interval;
+        m_latency = data_path.latency;
     }
 
-    bool isRegPort(const dev::InPort::Id& port) {
-        return m_reg_ports.find(port) != m_reg_ports.end();
+    bool isRegPort(dev::InPort::Id port) const {
+        return m_in_ports[util::asInt(port)].sink == Sink::REGISTER;
     }
 
-    bool isOutput(const dev::InPort::Id& port) {
-        return m_output_ports.find(port) != m_output_ports.end();
+    uint32_t width(dev::InPort::Id port) const {
+        return m_in_ports[util::asInt(port)].width;
     }
 
     std::string name(const dev::Input& input) {
@@ -202,20 +410,12 @@ private:
         return input.name;
     }
 
-    std::string name(const dev::InPort::Id& port) {
-        return std::visit([&](auto& device) {
-            using Device = std::decay_t<decltype(device.get())>;
-            if constexpr (std::is_same_v<Device, dev::Register> || std::is_same_v<Device, dev::Output>)
-                return name(device);
-            else
-                return fmt::format("{}_in{}", name(device), util::asInt(port));
-        }, m_device_by_port.at(port));
+    const std::string& name(dev::InPort::Id port) const {
+        return m_in_ports[util::asInt(port)].name;
     }
 
-    std::string name(const dev::OutPort::Id& port) {
-        return std::visit([&](auto& device) {
-            return name(device);
-        }, m_device_by_port.at(port));
+    const std::string& name(dev::OutPort::Id port) const {
+        return m_out_names[util::asInt(port)];
     }
 
     std::string name(const dev::Register& reg) {
@@ -230,38 +430,42 @@ private:
         return fmt::format("mul{}", util::asInt(multiplier.id));
     }
 
+    std::string name(const dev::Constant& constant) {
+        return fmt::format("const{}", util::asInt(constant.id));
+    }
+
+    std::string name(const dev::ConstMultiplier& multiplier) {
+        return fmt::format("mulc{}", util::asInt(multiplier.id));
+    }
+
     std::ostream& m_os;
+    const DumpOptions& m_options;
     const std::list<dev::Input>& m_inputs;
     const std::list<dev::Output>& m_outputs;
+    const std::list<dev::Constant>& m_constants;
     const std::list<dev::Adder>& m_adders;
     const std::list<dev::Multiplier>& m_multipliers;
+    const std::list<dev::ConstMultiplier>& m_const_multipliers;
     const std::unordered_map<dev::DeviceId, dev::Register>& m_registers;
-    std::unordered_map<
-        std::variant<
-            dev::InPort::Id,
-            dev::OutPort::Id
-        >,
-        std::variant<
-            std::reference_wrapper<const dev::Input>,
-            std::reference_wrapper<const dev::Output>,
-            std::reference_wrapper<const dev::Register>,
-            std::reference_wrapper<const dev::Adder>,
-            std::reference_wrapper<const dev::Multiplier>
-        >
-    > m_device_by_port;
-    std::unordered_set<dev::InPort::Id> m_reg_ports;
-    std::unordered_set<dev::InPort::Id> m_output_ports;
-    std::set<dev::InPort::Id> m_in_ports;
-    std::multimap<uint32_t, std::tuple<dev::InPort::Id, dev::OutPort::Id>> m_drivers_by_state;
+    const std::vector<std::vector<Driver>>& m_drivers;
+    std::vector<InPortInfo> m_in_ports;
+    std::vector<std::string> m_out_names;
+    // in ports of functional units in order of ids, which are X when not driven
+    std::vector<dev::InPort::Id> m_unit_ports;
+    // the last state every in port is driven in
+    std::vector<uint32_t> m_assigned_in;
+    fmt::memory_buffer m_buf;
     uint32_t m_last_state;
     uint32_t m_out_state;
     unsigned m_state_msb;
+    uint32_t m_initiation_interval;
+    uint32_t m_latency;
 };
 
 } // namespace
 
-void dump(std::ostream& os, const DataPath& data_path) {
-    Dumper(os, data_path).dump();
+void dump(std::ostream& os, const DataPath& data_path, const DumpOptions& options) {
+    Dumper(os, data_path, options).dump();
 }
 
 } // namespace verilog
@@ -0,0 +1,82 @@
+# checks exprc on random programs of exprc-gen, run by ctest as
+#   cmake -DCHECK=verify|cpp|batch|fail -DEXPRC=... -DEXPRC_GEN=... -DDIR=... [-DFLAGS=...] -P check.cmake
+# verify compares designs made with FLAGS against programs, cpp builds C++
+# of them and of PROGRAMS with CXX, batch compiles them at once; fail runs
+# exprc with FLAGS alone and expects it to exit with an error matching ERROR
+
+separate_arguments(FLAGS)
+separate_arguments(PROGRAMS)
+
+file(REMOVE_RECURSE ${DIR})
+file(MAKE_DIRECTORY ${DIR})
+
+# runs the command writing stdout into the file, stops on failure
+function(run output)
+    execute_process(COMMAND ${ARGN}
+        OUTPUT_FILE ${output}
+        ERROR_VARIABLE error
+        RESULT_VARIABLE result
+    )
+    if(NOT result EQUAL 0)
+        string(REPLACE ";" " " command "${ARGN}")
+        message(FATAL_ERROR "${command} failed: ${error}")
+    endif()
+endfunction()
+
+if(CHECK STREQUAL "fail")
+    execute_process(COMMAND ${EXPRC} ${FLAGS}
+        OUTPUT_QUIET
+        ERROR_VARIABLE error
+        RESULT_VARIABLE result
+    )
+    if(NOT result EQUAL 1 OR NOT error MATCHES "${ERROR}")
+        string(REPLACE ";" " " command "${FLAGS}")
+        message(FATAL_ERROR "exprc ${command} exited with ${result} instead of an error matching '${ERROR}': ${error}")
+    endif()
+    return()
+endif()
+
+# programs of different shapes, small enough to verify quickly
+set(programs ${PROGRAMS})
+foreach(seed RANGE 1 8)
+    math(EXPR assignments "${seed} * 40")
+    math(EXPR inputs "${seed} % 4 + 1")
+    set(program ${DIR}/gen${seed}.txt)
+    run(${program} ${EXPRC_GEN} --assignments ${assignments} --inputs ${inputs} --fanout 2 --seed ${seed})
+    list(APPEND programs ${program})
+endforeach()
+
+if(CHECK STREQUAL "verify")
+    foreach(program ${programs})
+        run(${DIR}/out.v ${EXPRC} ${FLAGS} --verify 200 ${program})
+    endforeach()
+elseif(CHECK STREQUAL "cpp")
+    foreach(program ${programs})
+        get_filename_component(name ${program} NAME_WE)
+        run(${DIR}/${name}.cpp ${EXPRC} ${FLAGS} --emit cpp --harness ${program})
+        run(${DIR}/${name}.log ${CXX} -std=c++17 -O2 -Wall -pedantic -Werror -o ${DIR}/${name} ${DIR}/${name}.cpp)
+    endforeach()
+elseif(CHECK STREQUAL "batch")
+    file(MAKE_DIRECTORY ${DIR}/out)
+    run(${DIR}/batch.log ${EXPRC} ${FLAGS} --batch ${DIR} -j 3 -o ${DIR}/out)
+    foreach(program ${programs})
+        get_filename_component(name ${program} NAME_WE)
+        if(NOT EXISTS ${DIR}/out/${name}.v)
+            message(FATAL_ERROR "--batch did not write ${name}.v")
+        endif()
+    endforeach()
+    # an output the same as a program, however the path is written, is
+    # refused before anything is compiled
+    file(WRITE ${DIR}/manifest.txt "gen1.txt\n./gen1.txt\n")
+    execute_process(COMMAND ${EXPRC} --batch ${DIR}/manifest.txt ERROR_VARIABLE error RESULT_VARIABLE result)
+    if(result EQUAL 0 OR NOT error MATCHES "both write")
+        message(FATAL_ERROR "--batch took a program listed twice: ${error}")
+    endif()
+    file(WRITE ${DIR}/manifest.txt "out/gen1.v\n")
+    execute_process(COMMAND ${EXPRC} --batch ${DIR}/manifest.txt ERROR_VARIABLE error RESULT_VARIABLE result)
+    if(result EQUAL 0 OR NOT error MATCHES "overwritten")
+        message(FATAL_ERROR "--batch overwrote a program with its output: ${error}")
+    endif()
+else()
+    message(FATAL_ERROR "unknown check '${CHECK}'")
+endif()